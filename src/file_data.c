@@ -1,3 +1,6 @@
+#define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE
+
 #include "file_data.h"
 
 #include <stdlib.h>
@@ -5,8 +8,195 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <zlib.h>
+
+#define APPEND_CHUNK_SIZE 65536
+#define NODE_CHUNK_SIZE 1024
+#define MIN_SLOT_CLASS 4
+#define SCAN_BLOCK_SIZE 64
+#define LOAD_CHUNK_SIZE (8 * 1024 * 1024)
+#define LOAD_MAX_THREADS 16
+#define LAZY_LOAD_MARGIN 1024
+#define LOAD_READ_BLOCK (1024 * 1024)
+#define SAVE_IOV_COUNT 1024
+#define SAVE_COPY_MIN_SIZE (64 * 1024)
+#define SAVE_DEFLATE_SIZE (256 * 1024)
+#define SAVE_DEFLATE_PART (1 << 30)
+#define LOAD_GZIP_RESERVE ((int64_t) 1 << 40)
+#define LOAD_GZIP_COMMIT (64 * 1024 * 1024)
+#define LINE_INDEX_MAGIC "NTEIDX2\n"
+#define LINE_INDEX_SUFFIX ".lineidx"
+#define LINE_INDEX_SAMPLES 16
+#define LINE_INDEX_SAMPLE_SIZE 4096
+#define LINE_ENCODING_UNKNOWN -1
+#define LINE_TABS_UNKNOWN -1
+#define ROW_LAYOUT_CACHE_SIZE 64
+
+#if defined(__x86_64__) && !defined(FILE_DATA_SCALAR_SCAN)
+#define SCAN_SIMD
+#include <immintrin.h>
+#endif
+
+typedef struct LoadChunk LoadChunk;
+typedef struct LoadState LoadState;
+typedef struct SaveBuffer SaveBuffer;
+typedef struct LineIndexHeader LineIndexHeader;
+
+/**
+ * @brief Part of a file being loaded, made of whole source lines.
+ * 
+ * The lines are indexed independently of the other chunks, in a node list and node pool
+ * that are spliced into the FileData structure in order.
+ */
+struct LoadChunk
+{
+    char *start;
+    int64_t size;
+    FileNode *first;
+    FileNode *last;
+    FileNodeChunk *node_chunks;
+    unsigned int seed;
+    int done;
+    int ret;
+};
+
+/**
+ * @brief Shared state of the threads indexing the chunks of a file being loaded.
+ */
+struct LoadState
+{
+    LoadChunk *chunks;
+    int count;
+    int next;
+    uint64_t (*scan_block)(const char *block, uint64_t *high, uint64_t *tabs);
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_done;
+};
+
+/**
+ * @brief Background load of a file: a reader thread fills the original buffer in blocks,
+ * the lines read so far are indexed by @ref file_data_load_poll().
+ * 
+ * Gzip files (gz) are decompressed into an address range reserved for the original buffer (reserved bytes),
+ * whose pages are made writable as the content grows (capacity), so the lines indexed so far never move.
+ * The size is the size of the file on disk, input_read the bytes of it read so far.
+ * 
+ * The read counters are shared with the reader thread, which signals progress when they change;
+ * the indexed size is only used by the polling thread.
+ */
+struct FileLoader
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t progress;
+    FILE *file;
+    gzFile gz;
+    char *buffer;
+    int64_t size;
+    int64_t capacity;
+    int64_t reserved;
+    int64_t bytes_read;
+    int64_t input_read;
+    int done;
+    int cancel;
+    int ret;
+    int error;
+
+    int64_t indexed;
+    int64_t searched;
+    int64_t polled;
+    struct timespec start_time;
+};
+
+/**
+ * @brief Pending writes of a save from a file offset, flushed with pwritev calls when full.
+ * 
+ * Adjacent parts of the same buffer are merged, so unchanged lines of the original buffer
+ * are written together with their new lines. Large parts of the original buffer are copied
+ * from the original file instead (copy_fd, -1 if not possible), the original buffer
+ * starting at offset 0 of the file.
+ * 
+ * Compressed saves (compress) go through a gzip stream instead, the compressed output is written
+ * each time the output buffer is full.
+ */
+struct SaveBuffer
+{
+    int fd;
+    int64_t offset;
+    int copy_fd;
+    char *copy_base;
+    int64_t copy_size;
+    struct iovec iov[SAVE_IOV_COUNT];
+    int count;
+    int64_t written;
+
+    int compress;
+    z_stream stream;
+    unsigned char out[SAVE_DEFLATE_SIZE];
+};
+
+/**
+ * @brief Line index cache of a memory mapped file: the length of each line, with its new line,
+ * shifted left by one with the lowest bit set if the line has tabs, as a variable length integer
+ * (7 bits per byte, least significant first).
+ * 
+ * The cache is either read from the sidecar file, to index the file without scanning it,
+ * or built while the file is scanned and written to the sidecar file once the whole file is indexed.
+ */
+struct FileLineIndex
+{
+    char *path;
+    unsigned char *data;
+    int64_t size;
+    int64_t capacity;
+    int64_t pos;
+    int64_t lines;
+    int reading;
+};
+
+/**
+ * @brief Display lines of a line with tabs: the first byte and the visual column of each display line.
+ * 
+ * Layouts are cached by node address in a table of ROW_LAYOUT_CACHE_SIZE entries, a layout is dropped when
+ * its line is changed or released, and all layouts are dropped when the number of display columns changes.
+ */
+struct FileRowLayout
+{
+    const FileNode *node;
+    int64_t rows;
+    int64_t capacity;
+    int64_t *starts;
+    int64_t *visual;
+};
 
-#define TAB_SIZE 4
+/**
+ * @brief Header of a line index sidecar file, followed by the line lengths.
+ * 
+ * The cache is valid if the file has the same identity, size and modification time, and the same fingerprint
+ * (hash of sampled blocks of its content); the checksum protects the line lengths.
+ */
+struct LineIndexHeader
+{
+    char magic[8];
+    int64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t inode;
+    int64_t lines;
+    uint64_t fingerprint;
+    int64_t data_size;
+    uint64_t checksum;
+};
 
 // ----------------------------- Private declarations -----------------------------
 
@@ -14,23 +204,40 @@
  * @brief Insert new FileNode to FileData structure.
  * 
  * The newly inserted node is a succesor to the node given as parameter (NULL for the start node).
- * The node data is initialized with provided values.
- * If provided, the data from content buffer is copied to the data of the created node.
- * 
- * By default any new node is marked as end of line. If the previous node is on the same source file
- * line as the inserted node, the previous node will have its end of line flag removed.
+ * If provided, the data from content buffer is copied to the writable slot of the created node.
  * 
  * @param file_data FileData structure in which the node should be added
  * @param node the node after which this new node should be inserted (NULL for the first node)
- * @param line the source file line number of the node data
- * @param col_start the index of the start character on the source file line
- * @param endl flag if the current display line is the last in the source file line
  * @param content_buffer buffer to copy line content (NULL if no copy is wanted)
- * @param len the length of the content buffer (should be 0 if content_buffer is NULL,
- *            should not exceed number of display columns configured in FileData structure)
+ * @param len the length of the content buffer (should be 0 if content_buffer is NULL)
+ * @return FileNode* pointer to the new created node or NULL on error
+ */
+static FileNode* insert_node(FileData *file_data, FileNode *node, char *content_buffer, int64_t len);
+
+/**
+ * @brief Insert new FileNode referencing a read-only span.
+ * 
+ * Same as @ref insert_node(), but the content is not copied, the node content points directly to the span.
+ * The span should not be modified while referenced (original buffer or content of another read-only node).
+ * 
+ * @param file_data FileData structure in which the node should be added
+ * @param node the node after which this new node should be inserted (NULL for the first node)
+ * @param span pointer to the start of the span
+ * @param len the length of the span
+ * @return FileNode* pointer to the new created node or NULL on error
+ */
+static FileNode* insert_span(FileData *file_data, FileNode *node, char *span, int64_t len);
+
+/**
+ * @brief Allocate a new FileNode and link it in the FileData structure.
+ * 
+ * The node is created without content.
+ * 
+ * @param file_data FileData structure in which the node should be added
+ * @param node the node after which this new node should be inserted (NULL for the first node)
  * @return FileNode* pointer to the new created node or NULL on error
  */
-static FileNode* insert_node(FileData *file_data, FileNode *node, int line, int col_start, int endl, char *content_buffer, int len);
+static FileNode* link_node(FileData *file_data, FileNode *node);
 
 /**
  * @brief Delete node from FileData structure.
@@ -41,926 +248,5084 @@ static FileNode* insert_node(FileData *file_data, FileNode *node, int line, int
 static void delete_node(FileData *file_data, FileNode *node);
 
 /**
- * @brief Find linkded list node by index.
+ * @brief Find the source line node containing a display line.
  * 
  * @param file_data pointer to FileData structure
- * @param index node index
+ * @param index display line index
+ * @param row output parameter for the position of the display line in the source line (can be NULL)
  * @return FileNode* pointer to found node or NULL if not found or invalid index
  */
-static FileNode* find_node(const FileData *file_data, int index);
+static FileNode* find_node(const FileData *file_data, int64_t index, int64_t *row);
+
+/**
+ * @brief Find the source line node and column of an insert position.
+ * 
+ * Inserting at the end of a display line is allowed only for the last display line of a source line.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param line display line index
+ * @param col display column
+ * @param source_col output parameter for the column in the source line
+ * @return FileNode* pointer to found node or NULL if invalid position
+ */
+static FileNode* find_insert_position(FileData *file_data, int64_t line, int64_t col, int64_t *source_col);
+
+/**
+ * @brief Find the node of a source line.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param index source line index
+ * @return FileNode* pointer to found node or NULL if invalid index
+ */
+static FileNode* find_line_node(const FileData *file_data, int64_t index);
+
+/**
+ * @brief Get the number of display lines of a source line without tabs.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param size length of the source line
+ * @return int64_t number of display lines (at least 1)
+ */
+static int64_t line_rows(const FileData *file_data, int64_t size);
+
+/**
+ * @brief Compute the number of display lines of a node after its content has changed.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ */
+static void update_display_rows(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Check if a line may contain tabs, searching it only if it is not known.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ * @return int 1 if the line may contain tabs, 0 otherwise
+ */
+static int line_tabs(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Get a byte of a line, skipping the gap of the edited line.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ * @param col source column
+ * @return char byte at the column
+ */
+static char line_byte(const FileData *file_data, const FileNode *node, int64_t col);
+
+/**
+ * @brief Split a line with tabs into display lines of at most display_cols visual columns.
+ * 
+ * A display line ends before the byte that would cross its last column, but holds at least one byte.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ * @param starts output array for the first byte of each display line, or NULL to only count them
+ * @param visual output array for the visual column of each display line, or NULL
+ * @return int64_t number of display lines
+ */
+static int64_t scan_row_layout(const FileData *file_data, const FileNode *node, int64_t *starts, int64_t *visual);
+
+/**
+ * @brief Get the cached display lines of a line with tabs, computing them on a cache miss.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ * @return FileRowLayout* the layout of the line, NULL on error
+ */
+static FileRowLayout* row_layout(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Get the cache entry of the display lines of a line.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ * @return FileRowLayout* cache entry for the node address (layout of another line if node doesn't match), NULL if there is no cache
+ */
+static FileRowLayout* row_layout_slot(const FileData *file_data, const FileNode *node);
+
+/**
+ * @brief Drop the cached display lines of a line.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ */
+static void drop_row_layout(FileData *file_data, const FileNode *node);
+
+/**
+ * @brief Drop all cached display lines.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param release also release the memory of the cache
+ */
+static void clear_row_layouts(FileData *file_data, int release);
+
+/**
+ * @brief Get the source columns of a display line of a node.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ * @param row display line index inside the node
+ * @param col_start output parameter for the first source column of the display line
+ * @param size output parameter for the number of bytes of the display line
+ * @param visual_start output parameter for the visual column of the first byte, or NULL
+ * @return int 0 for success, < 0 for failure
+ */
+static int row_bounds(FileData *file_data, FileNode *node, int64_t row, int64_t *col_start, int64_t *size, int64_t *visual_start);
+
+/**
+ * @brief Get the display line of a node showing a source column.
+ * 
+ * A column on a display line boundary is shown at the end of the previous display line.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ * @param col source column (at most the line size)
+ * @return int64_t display line index inside the node, < 0 for failure
+ */
+static int64_t col_row(FileData *file_data, FileNode *node, int64_t col);
+
+/**
+ * @brief Update FileData counters after the structure has been modified.
+ * 
+ * @param file_data pointer to FileData structure
+ */
+static void update_counters(FileData *file_data);
+
+/**
+ * @brief Link a node that was inserted in the linked list into the index tree.
+ * 
+ * The node should already be linked in the list (prev and next set), as its position in the tree
+ * is derived from its neighbours.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the newly inserted node
+ */
+static void tree_insert(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Unlink a node from the index tree.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node to be removed
+ */
+static void tree_remove(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Add the nodes at the end of the linked list to the index tree, in linear time.
+ * 
+ * Each node is attached on the right spine of the tree built so far, in list order.
+ * Only the new nodes and their ancestors are updated.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param first first node of the list that is not in the tree (NULL if none)
+ */
+static void tree_append(FileData *file_data, FileNode *first);
+
+/**
+ * @brief Update subtree counters of the nodes appended or moved in the tree (weight 0), skipping unchanged subtrees.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node root of the subtree
+ */
+static void tree_update_appended(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Rotate node above its parent in the index tree.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node to be rotated (should have a parent)
+ */
+static void tree_rotate_up(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Recompute subtree counters of a node from its children.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to tree node
+ */
+static void tree_update(const FileData *file_data, FileNode *node);
+
+/**
+ * @brief Recompute subtree counters of a node and all its ancestors.
+ * 
+ * This should be called after the size of a line has changed.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to tree node
+ */
+static void tree_update_path(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Update subtree display line counts after the content of a line has changed.
+ * 
+ * Ancestors are updated only if the number of display lines of the line has changed,
+ * so most edits inside a line don't touch the index tree.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to tree node
+ */
+static void tree_update_size(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Recompute display lines and subtree counters of a whole subtree.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node root of the subtree
+ */
+static void tree_update_all(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Get the index of the first display line of a node.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to tree node
+ * @return int64_t display line index
+ */
+static int64_t tree_row_index(const FileData *file_data, const FileNode *node);
+
+/**
+ * @brief Get the source line number of a node.
+ * 
+ * Line numbers are not stored, a node's line number is the number of nodes before it in the index tree.
+ * 
+ * @param node pointer to tree node
+ * @return int64_t source line index
+ */
+static int64_t tree_line_index(const FileNode *node);
+
+/**
+ * @brief Assert index tree integrity of a subtree.
+ * 
+ * The subtree is traversed in order and compared with the linked list structure.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node root of the subtree
+ * @param list_node pointer to the next expected list node (advanced during traversal)
+ * @return int64_t weight of the subtree
+ */
+static int64_t tree_check_integrity(const FileData *file_data, FileNode *node, FileNode **list_node);
+
+/**
+ * @brief Generate pseudo-random priority for a new tree node.
+ * 
+ * @param file_data pointer to FileData structure (holds generator state)
+ * @return unsigned int priority
+ */
+static unsigned int next_priority(FileData *file_data);
+
+/**
+ * @brief Advance a xorshift32 random generator.
+ * 
+ * @param state pointer to the generator state (not 0)
+ * @return unsigned int next random number
+ */
+static unsigned int next_random(unsigned int *state);
+
+/**
+ * @brief Ensure node content is stored in a writable slot of at least given capacity.
+ * 
+ * If the node content is a read-only span or the slot is too small, the content is copied into
+ * a new slot. Slots of edited lines grow geometrically, so repeated edits of a line are amortized.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ * @param capacity minimum capacity of the slot (should be greater than the line size)
+ * @return int 0 for success, < 0 for failure
+ */
+static int reserve_line(FileData *file_data, FileNode *node, int64_t capacity);
+
+/**
+ * @brief Set the line being edited.
+ * 
+ * The gap of the previously edited line is closed and its slot is shrunk to fit its content.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node being edited (NULL if none)
+ */
+static void set_edit_node(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Mark a position as modified, the next save rewrites the file from the first modified position.
+ * 
+ * The encoding of the line is checked again when it is displayed and its cached display lines are dropped.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node node of the modified line
+ * @param col source column of the modification
+ */
+static void mark_modified(FileData *file_data, FileNode *node, int64_t col);
+
+/**
+ * @brief Move the gap of the edited line to a position, ensuring it has a minimum size.
+ * 
+ * The edited line content is split by the gap: characters before the position are stored at the
+ * start of the slot and the characters after it at the end of the slot, so repeated edits at the
+ * same position don't move the rest of the line.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param pos position of the gap in the edited line
+ * @param len minimum size of the gap
+ * @return int 0 for success, < 0 for failure
+ */
+static int open_gap(FileData *file_data, int64_t pos, int64_t len);
+
+/**
+ * @brief Remove the gap of the edited line, making its content contiguous.
+ * 
+ * @param file_data pointer to FileData structure
+ */
+static void close_gap(FileData *file_data);
+
+/**
+ * @brief Shrink the slots of the lines edited inside a transaction.
+ * 
+ * @param file_data pointer to FileData structure
+ */
+static void fit_pending_lines(FileData *file_data);
+
+/**
+ * @brief Move writable node content into a slot of exact size.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ */
+static void fit_line(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Get the capacity of a writable slot fitting a line.
+ * 
+ * @param size the size of the line
+ * @return int64_t slot capacity
+ */
+static int64_t fit_capacity(int64_t size);
 
 /**
- * @brief Shift contents of display lines to perserve structure.
+ * @brief Shrink line size, keeping null termination of writable content.
  * 
- * Each source file line can be represented by multiple display lines.
- * Each display line corresponding to a source file line is completed,
- * with the exception of the last line which may have arbitrary length.
+ * @param node pointer to the node
+ * @param len the new size of the line
+ */
+static void truncate_line(FileNode *node, int64_t len);
+
+/**
+ * @brief Allocate a FileNode from the node pool.
  * 
- * This function recursivelly normalizes content following an incomplete line.
+ * @param file_data pointer to FileData structure
+ * @return FileNode* pointer to uninitialized node or NULL on error
+ */
+static FileNode* alloc_node(FileData *file_data);
+
+/**
+ * @brief Allocate a FileNode from a node pool.
  * 
- * If a line has been completely emptied, it will be removed.
+ * @param node_chunks pointer to the chunk list of the pool, the first chunk is the one being filled
+ * @return FileNode* pointer to the allocated node or NULL on error
+ */
+static FileNode* alloc_pool_node(FileNodeChunk **node_chunks);
+
+/**
+ * @brief Return a FileNode to the node pool free list.
  * 
  * @param file_data pointer to FileData structure
- * @param node node with line to be normalized
- * @return Node* the first node of the next source line
+ * @param node pointer to the node
  */
-static FileNode* normalize_line(FileData *file_data, FileNode *node);
+static void release_node(FileData *file_data, FileNode *node);
 
 /**
- * @brief Free node inner data structure.
+ * @brief Allocate a writable line slot.
  * 
- * @param node pointer to node with data to be freed
+ * The capacity is rounded up to a power of two size class, the slot is taken from the
+ * class free list or from the append buffer.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param capacity input minimum capacity, output actual capacity of the slot
+ * @return char* pointer to the slot or NULL on error
  */
-static void free_node_data(FileNode *node);
+static char* alloc_slot(FileData *file_data, int64_t *capacity);
+
+/**
+ * @brief Return a writable line slot to a class free list.
+ * 
+ * The slot is added to the largest class it can hold, slots smaller than the minimum class
+ * are not reused.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param slot pointer to the slot
+ * @param capacity capacity of the slot
+ */
+static void release_slot(FileData *file_data, char *slot, int64_t capacity);
+
+/**
+ * @brief Get the size class of a slot capacity.
+ * 
+ * @param capacity slot capacity
+ * @return int size class (slot capacity is 1 << class) or -1 if too large
+ */
+static int slot_class(int64_t capacity);
+
+/**
+ * @brief Allocate memory from the append buffer.
+ * 
+ * The memory is released only when the FileData structure is freed.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param len number of bytes to allocate
+ * @return char* pointer to allocated memory or NULL on error
+ */
+static char* append_buffer_alloc(FileData *file_data, int64_t len);
+
+/**
+ * @brief Read whole file into the original buffer.
+ * 
+ * Files of at least lazy_load_size bytes are memory mapped instead of read.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param f file pointer to read from
+ * @return int 0 for success, < 0 for failure
+ */
+static int read_original(FileData *file_data, FILE *f);
+
+/**
+ * @brief Index lines of a memory mapped file until the structure is large enough.
+ * 
+ * Lines are indexed one load chunk at a time, from the unindexed part of the mapping.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param rows index the file until it has more display lines than this number
+ * @param lines index the file until it has more source lines than this number
+ * @return int 0 for success, < 0 for failure
+ */
+static int index_lazy(FileData *file_data, int64_t rows, int64_t lines);
+
+/**
+ * @brief Write the content of FileData to a file.
+ * 
+ * Unchanged parts of the original buffer can be copied from the original file (if copy_fd is not -1),
+ * which must be unchanged since it was loaded.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param start first node to be written
+ * @param start_col first column of the first node to be written
+ * @param fd descriptor of the output file
+ * @param offset file offset of the first written column
+ * @param copy_fd descriptor of the original file (-1 to write everything from memory)
+ * @param compression compression of the written content (copy_fd must be -1 if compressed)
+ * @param written output parameter for the number of bytes written
+ * @return int 0 for success, < 0 for failure
+ */
+static int write_file_data(FileData *file_data, FileNode *start, int64_t start_col, int fd, int64_t offset, int copy_fd,
+    FileDataCompression compression, int64_t *written);
+
+/**
+ * @brief Save FileData to a temporary file which replaces the output file.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param file_path path of the output file (not a symbolic link)
+ * @param written output parameter for the number of bytes written
+ * @return int 0 for success, < 0 for failure
+ */
+static int save_replace(FileData *file_data, const char *file_path, int64_t *written);
+
+/**
+ * @brief Find the content to be rewritten by an in place save, from the first modified position.
+ * 
+ * An in place save is possible if the file is the one last loaded or saved, unchanged on disk and exact,
+ * if the rewritten content is at most half of the file and, for memory mapped files, if it isn't read
+ * from the mapping, whose pages would be overwritten.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param file_path path of the output file (not a symbolic link)
+ * @param start output parameter for the first node to be rewritten (NULL if none)
+ * @param start_col output parameter for the first column of the first node to be rewritten
+ * @param offset output parameter for the file offset of the first rewritten column
+ * @return int 1 if the file can be saved in place, 0 otherwise
+ */
+static int find_in_place_start(FileData *file_data, const char *file_path, FileNode **start, int64_t *start_col, int64_t *offset);
+
+/**
+ * @brief Rewrite the end of the output file in place, from a position.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param file_path path of the output file (not a symbolic link)
+ * @param start first node to be rewritten (NULL if none)
+ * @param start_col first column of the first node to be rewritten
+ * @param offset file offset of the first rewritten column
+ * @param written output parameter for the number of bytes written
+ * @return int 0 for success, < 0 for failure
+ */
+static int save_in_place(FileData *file_data, const char *file_path, FileNode *start, int64_t start_col, int64_t offset, int64_t *written);
+
+/**
+ * @brief Remember the file loaded or saved, as the content of the structure with no modified lines.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param fd descriptor of the file
+ */
+static void set_disk_state(FileData *file_data, int fd);
+
+/**
+ * @brief Keep the original file open, so that saves can copy its unchanged parts.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param fd descriptor of the original file (duplicated)
+ */
+static void set_original_file(FileData *file_data, int fd);
+
+/**
+ * @brief Fill a disk state with the identity, size and modification time of a file.
+ * 
+ * The exact flag is not changed.
+ * 
+ * @param file_stat status of the file
+ * @param state pointer to the disk state
+ */
+static void get_disk_state(const struct stat *file_stat, FileDataDiskState *state);
+
+/**
+ * @brief Check if a file is the one of a disk state and is unchanged since.
+ * 
+ * @param file_stat status of the file
+ * @param state pointer to the disk state
+ * @return int 1 if the file is unchanged, 0 otherwise
+ */
+static int same_disk_state(const struct stat *file_stat, const FileDataDiskState *state);
+
+/**
+ * @brief Get the path of the line index sidecar file of a file (hidden file in the same directory).
+ * 
+ * @param file_name name of the file
+ * @return char* allocated path or NULL on error
+ */
+static char* line_index_path(const char *file_name);
+
+/**
+ * @brief Open the line index cache of a memory mapped file.
+ * 
+ * If the sidecar file is valid for the file, the cache is read from it, otherwise a new cache is built.
+ * 
+ * @param file_data pointer to FileData structure, with the file mapped
+ * @param file_name name of the file
+ */
+static void open_line_index(FileData *file_data, const char *file_name);
+
+/**
+ * @brief Read and validate the sidecar file of a line index cache.
+ * 
+ * @param file_data pointer to FileData structure, with the file mapped
+ * @param line_index pointer to the line index cache
+ * @return int 0 for success, < 0 if the sidecar file can't be used
+ */
+static int read_line_index(FileData *file_data, FileLineIndex *line_index);
+
+/**
+ * @brief Write a complete line index cache to its sidecar file, if the file is unchanged since it was loaded.
+ * 
+ * Failures are ignored, the file is indexed again the next time it is opened.
+ * 
+ * @param file_data pointer to FileData structure
+ */
+static void write_line_index(FileData *file_data);
+
+/**
+ * @brief Release the line index cache of a FileData structure.
+ * 
+ * @param file_data pointer to FileData structure
+ */
+static void free_line_index(FileData *file_data);
+
+/**
+ * @brief Add the lines of a scanned chunk to a line index cache being built.
+ * 
+ * @param line_index pointer to the line index cache
+ * @param chunk pointer to the chunk
+ * @return int 0 for success, < 0 for failure
+ */
+static int add_line_index_chunk(FileLineIndex *line_index, LoadChunk *chunk);
+
+/**
+ * @brief Index the lines of a chunk from a line index cache, without reading the chunk.
+ * 
+ * The chunk ends after the line that reaches LOAD_CHUNK_SIZE bytes, or at the end of the file.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param chunk pointer to the chunk (its start is set)
+ * @return int 0 for success, < 0 for failure
+ */
+static int read_line_index_chunk(FileData *file_data, LoadChunk *chunk);
+
+/**
+ * @brief Hash sampled blocks of a memory mapped file, to detect content changes.
+ * 
+ * @param file_data pointer to FileData structure, with the file mapped
+ * @return uint64_t fingerprint of the file
+ */
+static uint64_t file_fingerprint(FileData *file_data);
+
+/**
+ * @brief Continue a 64 bit FNV-1a hash over a buffer.
+ * 
+ * @param hash hash of the previous data
+ * @param buffer data
+ * @param size size of the data
+ * @return uint64_t hash
+ */
+static uint64_t hash_bytes(uint64_t hash, const unsigned char *buffer, int64_t size);
+
+/**
+ * @brief Add a part of a buffer to the pending writes of a save.
+ * 
+ * @param save pointer to SaveBuffer
+ * @param data start of the part
+ * @param size size of the part
+ * @return int 0 for success, < 0 for failure
+ */
+static int save_append(SaveBuffer *save, char *data, int64_t size);
+
+/**
+ * @brief Write the pending writes of a save.
+ * 
+ * @param save pointer to SaveBuffer
+ * @return int 0 for success, < 0 for failure
+ */
+static int save_flush(SaveBuffer *save);
+
+/**
+ * @brief Write parts of buffers at the current position of a save.
+ * 
+ * @param save pointer to SaveBuffer
+ * @param iov parts to be written (modified by partial writes)
+ * @param count number of parts
+ * @return int 0 for success, < 0 for failure
+ */
+static int save_write(SaveBuffer *save, struct iovec *iov, int count);
+
+/**
+ * @brief Copy a part of the original buffer from the original file at the current position of a save.
+ * 
+ * If the files don't support copying, the part and the rest of the save are written from memory.
+ * 
+ * @param save pointer to SaveBuffer
+ * @param iov part of the original buffer
+ * @return int 0 for success, < 0 for failure
+ */
+static int save_copy(SaveBuffer *save, struct iovec *iov);
+
+/**
+ * @brief Compress a part of a compressed save and write the compressed output produced.
+ * 
+ * @param save pointer to SaveBuffer
+ * @param data start of the part (NULL if size is 0)
+ * @param size size of the part
+ * @param flush zlib flush mode (Z_FINISH to end the stream)
+ * @return int 0 for success, < 0 for failure
+ */
+static int save_deflate(SaveBuffer *save, char *data, int64_t size, int flush);
+
+/**
+ * @brief Sync the directory containing a file, so that a file renamed into it is kept.
+ * 
+ * @param file_path path of the file
+ * @return int 0 for success, < 0 for failure
+ */
+static int sync_parent_dir(const char *file_path);
+
+/**
+ * @brief Split a part of the original buffer in source lines, appended to the structure.
+ * 
+ * The part is split in chunks of whole lines, indexed by a pool of worker threads
+ * and by the calling thread. The chunks are merged in order.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param buffer start of the part, at the start of a line
+ * @param size size of the part, ending after a new line or at the end of the file
+ * @return int 0 for success, < 0 for failure
+ */
+static int index_lines(FileData *file_data, char *buffer, int64_t size);
+
+/**
+ * @brief Start the reader thread of a background load.
+ * 
+ * The original buffer is allocated for the file content, or reserved for the decompressed content of a gzip file.
+ * 
+ * @param file_data pointer to an empty FileData structure
+ * @param fin opened file, closed by the call
+ * @param size size of the file
+ * @param compression compression of the file
+ * @return int 0 for success, < 0 for failure
+ */
+static int start_loader(FileData *file_data, FILE *fin, int64_t size, FileDataCompression compression);
+
+/**
+ * @brief Wait until the reader thread of a background load reads more bytes than seen by the last poll, or finishes.
+ * 
+ * @param loader pointer to the FileLoader
+ */
+static void wait_loader(FileLoader *loader);
+
+/**
+ * @brief Reader thread of a background load.
+ * 
+ * @param arg pointer to the FileLoader
+ * @return void* NULL
+ */
+static void* load_reader(void *arg);
+
+/**
+ * @brief Read the next block of a background load into the original buffer, decompressing gzip files.
+ * 
+ * @param loader pointer to the FileLoader
+ * @param offset number of bytes of the original buffer already read
+ * @return int64_t number of bytes read, 0 at the end of the file, < 0 for failure (errno is set)
+ */
+static int64_t load_read_block(FileLoader *loader, int64_t offset);
+
+/**
+ * @brief Check if a file is a gzip stream, from its magic bytes.
+ * 
+ * The file position is restored to the start of the file.
+ * 
+ * @param f file pointer
+ * @return int 1 if the file is gzip compressed, 0 otherwise
+ */
+static int gzip_file(FILE *f);
+
+/**
+ * @brief Stop the reader thread of a background load (if any) and release the loader.
+ * 
+ * @param file_data pointer to FileData structure
+ */
+static void stop_loader(FileData *file_data);
+
+/**
+ * @brief Get the size of a file.
+ * 
+ * @param f file pointer
+ * @param size output parameter for the file size
+ * @return int 0 for success, < 0 for failure
+ */
+static int get_file_size(FILE *f, int64_t *size);
+
+/**
+ * @brief Worker thread indexing chunks until none is left.
+ * 
+ * @param arg pointer to the shared LoadState
+ * @return void* NULL
+ */
+static void* load_worker(void *arg);
+
+/**
+ * @brief Claim the next chunk that is not indexed yet and index it.
+ * 
+ * @param state pointer to the shared LoadState
+ * @return int 1 if a chunk was indexed, 0 if no chunk was left
+ */
+static int load_next_chunk(LoadState *state);
+
+/**
+ * @brief Index the source lines of a chunk.
+ * 
+ * The chunk is scanned in blocks for new lines, the bytes are stored verbatim.
+ * Source lines are spans of the chunk, appended to the node list of the chunk.
+ * 
+ * @param chunk pointer to the chunk
+ * @param scan function computing the new lines and the non ASCII masks of a block
+ * @return int 0 for success, < 0 for failure
+ */
+static int scan_chunk(LoadChunk *chunk, uint64_t (*scan)(const char *block, uint64_t *high, uint64_t *tabs));
+
+/**
+ * @brief Allocate a new FileNode for a read-only span and append it to the node list of a chunk.
+ * 
+ * The index tree is not updated, the nodes are added with @ref tree_append() after the chunk is merged.
+ * 
+ * @param chunk pointer to the chunk
+ * @param span pointer to the span content
+ * @param len length of the span
+ * @param encoding encoding of the span (FileLineEncoding or LINE_ENCODING_UNKNOWN)
+ * @param tabs 1 if the span has tabs, 0 otherwise
+ * @return FileNode* pointer to the new created node or NULL on error
+ */
+static FileNode* append_span(LoadChunk *chunk, char *span, int64_t len, int encoding, int tabs);
+
+/**
+ * @brief Append the nodes of an indexed chunk to the FileData structure.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param chunk pointer to the chunk
+ */
+static void merge_chunk(FileData *file_data, LoadChunk *chunk);
+
+/**
+ * @brief Select the implementation of the new lines scan for this CPU.
+ * 
+ * The implementation returns a mask with bit i set if byte i of a block of SCAN_BLOCK_SIZE bytes is a new line,
+ * the mask of the bytes above 127 in the high output parameter and the mask of the tabs in the tabs output parameter.
+ * 
+ * @return function scanning a block (AVX2, SSE2 or scalar)
+ */
+static uint64_t (*select_scan_block(void))(const char *block, uint64_t *high, uint64_t *tabs);
+
+#ifndef SCAN_SIMD
+/**
+ * @brief Scalar implementation of the block scan for full blocks.
+ * 
+ * @param block pointer to a block of SCAN_BLOCK_SIZE bytes
+ * @param high output parameter for the non ASCII mask
+ * @param tabs output parameter for the tabs mask
+ * @return uint64_t new lines mask
+ */
+static uint64_t scan_full_block_scalar(const char *block, uint64_t *high, uint64_t *tabs);
+#endif
+
+/**
+ * @brief Scalar implementation of the block scan, also used for the last partial block.
+ * 
+ * @param block pointer to a block of at most SCAN_BLOCK_SIZE bytes
+ * @param len length of the block
+ * @param high output parameter for the non ASCII mask
+ * @param tabs output parameter for the tabs mask
+ * @return uint64_t new lines mask
+ */
+static uint64_t scan_block_scalar(const char *block, int len, uint64_t *high, uint64_t *tabs);
+
+#ifdef SCAN_SIMD
+/**
+ * @brief SSE2 implementation of the block scan.
+ * 
+ * @param block pointer to a block of SCAN_BLOCK_SIZE bytes
+ * @param high output parameter for the non ASCII mask
+ * @param tabs output parameter for the tabs mask
+ * @return uint64_t new lines mask
+ */
+static uint64_t scan_block_sse2(const char *block, uint64_t *high, uint64_t *tabs);
+
+/**
+ * @brief AVX2 implementation of the block scan.
+ * 
+ * @param block pointer to a block of SCAN_BLOCK_SIZE bytes
+ * @param high output parameter for the non ASCII mask
+ * @param tabs output parameter for the tabs mask
+ * @return uint64_t new lines mask
+ */
+static uint64_t scan_block_avx2(const char *block, uint64_t *high, uint64_t *tabs);
+#endif
+
+/**
+ * @brief Get the encoding of a line, checking it again if it was edited.
+ * 
+ * The gap of an edited line with multibyte characters is closed, so that it can be validated in one piece.
+ * 
+ * @param file_data pointer to FileData structure
+ * @param node pointer to the node
+ * @return FileLineEncoding encoding of the line content
+ */
+static FileLineEncoding line_encoding(FileData *file_data, FileNode *node);
+
+/**
+ * @brief Find the encoding of a text.
+ * 
+ * @param text pointer to the text
+ * @param size size of the text
+ * @return FileLineEncoding encoding of the text
+ */
+static FileLineEncoding text_encoding(const char *text, int64_t size);
+
+/**
+ * @brief Check if a text with bytes above 127 is valid UTF-8.
+ * 
+ * Overlong encodings, surrogates, code points above U+10FFFF and truncated characters are not valid.
+ * 
+ * @param text pointer to the text
+ * @param size size of the text
+ * @return int 1 if valid, 0 if not
+ */
+static int valid_utf8(const char *text, int64_t size);
+
+/**
+ * @brief Scalar implementation of the UTF-8 validation.
+ * 
+ * @param text pointer to the text
+ * @param size size of the text
+ * @return int 1 if valid, 0 if not
+ */
+static int valid_utf8_scalar(const unsigned char *text, int64_t size);
+
+#ifdef SCAN_SIMD
+/**
+ * @brief AVX2 implementation of the UTF-8 validation.
+ * 
+ * Blocks of 32 bytes are checked with table lookups on the high and low nibbles of each byte and of the
+ * previous byte, and the positions that must be continuation bytes of 3 and 4 byte characters.
+ * The last partial block is padded with zeros.
+ * 
+ * @param text pointer to the text
+ * @param size size of the text
+ * @return int 1 if valid, 0 if not
+ */
+static int valid_utf8_avx2(const char *text, int64_t size);
+
+/**
+ * @brief Find the invalid UTF-8 sequences of a block of 32 bytes.
+ * 
+ * @param input block
+ * @param prev previous block (zeros at the start of the text)
+ * @return __m256i non zero bytes where a sequence is invalid
+ */
+static __m256i utf8_block_errors(__m256i input, __m256i prev);
+#endif
+
+
+// ------------------------- Public functions definitions -------------------------
+
+int create_file_data(int64_t cols, FileData *file_data)
+{
+    if (file_data == NULL || cols < 1)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    file_data->display_cols = cols;
+    file_data->size = 0;
+    file_data->lines = 0;
+    file_data->start = NULL;
+    file_data->end = NULL;
+    file_data->current = NULL;
+    file_data->current_index = -1;
+    file_data->root = NULL;
+    file_data->seed = 2463534242u;
+    file_data->original = NULL;
+    file_data->original_size = 0;
+    file_data->final_newline = 1;
+    file_data->append = NULL;
+    file_data->node_chunks = NULL;
+    file_data->free_nodes = NULL;
+    memset(file_data->free_slots, 0, sizeof(file_data->free_slots));
+    file_data->edit_node = NULL;
+    file_data->gap_start = 0;
+    file_data->gap_size = 0;
+    file_data->transaction = 0;
+    file_data->pending_count = 0;
+    file_data->display_buffer = NULL;
+    file_data->display_buffer_size = 0;
+    file_data->row_layouts = NULL;
+    file_data->lazy_load_size = FILE_DATA_LAZY_LOAD_SIZE;
+    file_data->original_mapped = 0;
+    file_data->unindexed = NULL;
+    file_data->loader = NULL;
+    file_data->sync_policy = FILE_DATA_SYNC_FULL;
+    file_data->compression = FILE_DATA_COMPRESSION_NONE;
+    memset(&file_data->save_stats, 0, sizeof(file_data->save_stats));
+    memset(&file_data->disk, 0, sizeof(file_data->disk));
+    file_data->modified_line = INT64_MAX;
+    file_data->modified_col = 0;
+    file_data->original_fd = -1;
+    memset(&file_data->original_disk, 0, sizeof(file_data->original_disk));
+    file_data->line_index = NULL;
+
+    file_data->edit_node = insert_node(file_data, NULL, NULL, 0);
+    if (file_data->edit_node == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    return E_SUCCESS;
+}
+
+void free_file_data(FileData *file_data)
+{
+    // Reader thread of a background load writes to the original buffer
+    stop_loader(file_data);
+
+    FileNodeChunk *node_chunk = file_data->node_chunks;
+    while (node_chunk != NULL)
+    {
+        FileNodeChunk *del_node_chunk = node_chunk;
+        node_chunk = node_chunk->next;
+        free(del_node_chunk);
+    }
+
+    FileBuffer *chunk = file_data->append;
+    while (chunk != NULL)
+    {
+        FileBuffer *del_chunk = chunk;
+        chunk = chunk->next;
+        free(del_chunk);
+    }
+
+    if (file_data->original_mapped)
+    {
+        // Decompressed content of an empty gzip file still keeps a page of its range
+        munmap(file_data->original, file_data->original_size > 0 ? file_data->original_size : 1);
+    }
+    else
+    {
+        free(file_data->original);
+    }
+    free(file_data->display_buffer);
+    clear_row_layouts(file_data, 1);
+    file_data->original = NULL;
+    file_data->original_mapped = 0;
+    file_data->unindexed = NULL;
+    file_data->display_buffer = NULL;
+    file_data->display_buffer_size = 0;
+    file_data->original_size = 0;
+    file_data->final_newline = 1;
+    file_data->compression = FILE_DATA_COMPRESSION_NONE;
+    file_data->append = NULL;
+    file_data->node_chunks = NULL;
+    file_data->free_nodes = NULL;
+    memset(file_data->free_slots, 0, sizeof(file_data->free_slots));
+    file_data->edit_node = NULL;
+    file_data->gap_start = 0;
+    file_data->gap_size = 0;
+    file_data->transaction = 0;
+    file_data->pending_count = 0;
+    file_data->disk.exact = 0;
+
+    if (file_data->original_fd >= 0)
+    {
+        close(file_data->original_fd);
+    }
+    file_data->original_fd = -1;
+    file_data->original_disk.exact = 0;
+    free_line_index(file_data);
+
+    file_data->start = NULL;
+    file_data->end = NULL;
+    file_data->root = NULL;
+    file_data->current = NULL;
+    file_data->current_index = -1;
+    file_data->size = 0;
+    file_data->lines = 0;
+}
+
+int load_file_data(FileData *file_data, const char *file_name)
+{
+    if (file_data == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    free_file_data(file_data);
+
+    FILE *fin = fopen(file_name, "r");
+    if (fin == NULL)
+    {
+        return E_IO_ERROR;
+    }
+
+    // Gzip files are decompressed by a reader thread, while the lines decompressed so far are indexed
+    if (gzip_file(fin))
+    {
+        int64_t size;
+        int ret = get_file_size(fin, &size);
+        if (ret < 0)
+        {
+            fclose(fin);
+            return ret;
+        }
+
+        ret = start_loader(file_data, fin, size, FILE_DATA_COMPRESSION_GZIP);
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        while ((ret = file_data_load_poll(file_data, NULL)) == E_IN_PROGRESS)
+        {
+            wait_loader(file_data->loader);
+        }
+        return ret;
+    }
+
+    int ret = read_original(file_data, fin);
+    set_disk_state(file_data, fileno(fin));
+    set_original_file(file_data, fileno(fin));
+    fclose(fin);
+
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    file_data->final_newline = file_data->original_size > 0 && file_data->original[file_data->original_size - 1] == '\n';
+
+    // Each source line is a span of the original buffer
+    if (file_data->original_mapped)
+    {
+        open_line_index(file_data, file_name);
+        ret = index_lazy(file_data, 0, 0);
+    }
+    else
+    {
+        ret = index_lines(file_data, file_data->original, file_data->original_size);
+    }
+
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    // Empty file still has a line to edit
+    if (file_data->start == NULL)
+    {
+        file_data->edit_node = insert_node(file_data, NULL, NULL, 0);
+        if (file_data->edit_node == NULL)
+        {
+            return E_INTERNAL_ERROR;
+        }
+    }
+
+    return E_SUCCESS;
+}
+
+int file_data_load_start(FileData *file_data, const char *file_name)
+{
+    if (file_data == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    free_file_data(file_data);
+
+    FILE *fin = fopen(file_name, "r");
+    if (fin == NULL)
+    {
+        return E_IO_ERROR;
+    }
+
+    FileDataCompression compression = gzip_file(fin) ? FILE_DATA_COMPRESSION_GZIP : FILE_DATA_COMPRESSION_NONE;
+    int64_t size;
+    int ret = get_file_size(fin, &size);
+    if (ret < 0 || (compression == FILE_DATA_COMPRESSION_NONE && size > 0 && size >= file_data->lazy_load_size))
+    {
+        // Memory mapped files are indexed on request, they are ready right away
+        fclose(fin);
+        return ret < 0 ? ret : load_file_data(file_data, file_name);
+    }
+
+    return start_loader(file_data, fin, size, compression);
+}
+
+int file_data_load_poll(FileData *file_data, FileDataLoadProgress *progress)
+{
+    if (file_data == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    FileLoader *loader = file_data->loader;
+    if (loader == NULL)
+    {
+        if (progress != NULL)
+        {
+            progress->bytes_read = file_data->original_size;
+            progress->total_bytes = file_data->original_size;
+            progress->bytes_per_second = 0;
+        }
+        return E_SUCCESS;
+    }
+
+    pthread_mutex_lock(&loader->lock);
+    int64_t bytes_read = loader->bytes_read;
+    int64_t input_read = loader->input_read;
+    int done = loader->done;
+    int ret = loader->ret;
+    int error = loader->error;
+    loader->polled = bytes_read;
+    pthread_mutex_unlock(&loader->lock);
+
+    if (progress != NULL)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - loader->start_time.tv_sec) + (now.tv_nsec - loader->start_time.tv_nsec) / 1e9;
+
+        progress->bytes_read = input_read;
+        progress->total_bytes = loader->size;
+        progress->bytes_per_second = elapsed > 0 ? input_read / elapsed : 0;
+    }
+
+    if (ret < 0)
+    {
+        free_file_data(file_data);
+        errno = error;
+        return ret;
+    }
+
+    // Index the complete lines read so far, the rest of the file once it's read
+    char *start = file_data->original + loader->indexed;
+    char *end = file_data->original + bytes_read;
+    if (!done)
+    {
+        // Bytes after the indexed part searched by previous polls don't contain new lines
+        char *searched = file_data->original + loader->searched;
+        while (end > searched && end[-1] != '\n')
+        {
+            end--;
+        }
+
+        loader->searched = bytes_read;
+        if (end == searched)
+        {
+            end = start;
+        }
+    }
+
+    if (end > start)
+    {
+        ret = index_lines(file_data, start, end - start);
+        loader->indexed = end - file_data->original;
+        loader->searched = loader->searched > loader->indexed ? loader->searched : loader->indexed;
+        if (ret < 0)
+        {
+            free_file_data(file_data);
+            return ret;
+        }
+    }
+
+    if (!done)
+    {
+        return E_IN_PROGRESS;
+    }
+
+    stop_loader(file_data);
+
+    // Reserved pages after the decompressed content of a gzip file are released
+    if (file_data->original_mapped)
+    {
+        int64_t page = sysconf(_SC_PAGESIZE);
+        int64_t used = bytes_read > 0 ? (bytes_read + page - 1) / page * page : page;
+        munmap(file_data->original + used, file_data->original_size - used);
+    }
+
+    file_data->original_size = bytes_read;
+    file_data->final_newline = bytes_read > 0 && file_data->original[bytes_read - 1] == '\n';
+
+    // Empty file still has a line to edit
+    if (file_data->start == NULL)
+    {
+        file_data->edit_node = insert_node(file_data, NULL, NULL, 0);
+        if (file_data->edit_node == NULL)
+        {
+            return E_INTERNAL_ERROR;
+        }
+    }
+
+    return E_SUCCESS;
+}
+
+void file_data_load_cancel(FileData *file_data)
+{
+    free_file_data(file_data);
+}
+
+int file_data_remove_line_index(const char *file_name)
+{
+    if (file_name == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    char *path = line_index_path(file_name);
+    if (path == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    int ret = unlink(path) == 0 || errno == ENOENT ? E_SUCCESS : E_IO_ERROR;
+    free(path);
+    return ret;
+}
+
+int file_data_index_all(FileData *file_data)
+{
+    if (file_data == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    return index_lazy(file_data, INT64_MAX, INT64_MAX);
+}
+
+int save_file_data(FileData *file_data, const char* file_path)
+{
+    if (file_data == NULL || file_path == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    int ret = file_data_index_all(file_data);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    // Symbolic links are kept, the file they point to is replaced
+    char *real_path = realpath(file_path, NULL);
+    const char *target_path = real_path != NULL ? real_path : file_path;
+
+    FileNode *start;
+    int64_t start_col, offset, written = 0;
+    int in_place = file_data->compression == FILE_DATA_COMPRESSION_NONE && find_in_place_start(file_data, target_path, &start, &start_col, &offset);
+    if (in_place)
+    {
+        ret = save_in_place(file_data, target_path, start, start_col, offset, &written);
+    }
+    else
+    {
+        ret = save_replace(file_data, target_path, &written);
+    }
+
+    // Line index cache of the old content is no longer valid
+    if (ret == E_SUCCESS)
+    {
+        file_data_remove_line_index(target_path);
+    }
+
+    free(real_path);
+
+    if (ret == E_SUCCESS)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &end_time);
+        double elapsed = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+        file_data->save_stats.bytes_written = written;
+        file_data->save_stats.seconds = elapsed;
+        file_data->save_stats.bytes_per_second = elapsed > 0 ? written / elapsed : 0;
+        file_data->save_stats.in_place = in_place;
+    }
+
+    return ret;
+}
+
+void file_data_set_sync_policy(FileData *file_data, FileDataSyncPolicy policy)
+{
+    file_data->sync_policy = policy;
+}
+
+void file_data_set_compression(FileData *file_data, FileDataCompression compression)
+{
+    file_data->compression = compression;
+}
+
+int file_data_get_save_stats(FileData *file_data, FileDataSaveStats *stats)
+{
+    if (file_data == NULL || stats == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    *stats = file_data->save_stats;
+    return E_SUCCESS;
+}
+
+int resize_file_data_col(FileData *file_data, int64_t cols)
+{
+    if (file_data == NULL || cols < 1)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    // Line content stays in place, only display line counts change
+    file_data->display_cols = cols;
+    clear_row_layouts(file_data, 0);
+    tree_update_all(file_data, file_data->root);
+    update_counters(file_data);
+
+    return E_SUCCESS;
+}
+
+int set_file_data_line(FileData *file_data, int64_t index)
+{
+    if (file_data != NULL && index_lazy(file_data, index + LAZY_LOAD_MARGIN, -1) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    if (file_data == NULL || index < 0 || index >= file_data->size)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    FileNode* new_current = find_node(file_data, index, NULL);
+
+    if (new_current == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    file_data->current = new_current;
+    file_data->current_index = tree_row_index(file_data, new_current);
+    return E_SUCCESS;
+}
+
+const FileLine* get_file_data_line(FileData *file_data, int64_t index)
+{
+    // Lines of a memory mapped file are indexed on request, a margin after the requested line
+    if (file_data != NULL && index_lazy(file_data, index + LAZY_LOAD_MARGIN, -1) < 0)
+    {
+        return NULL;
+    }
+
+    if (file_data == NULL || index < 0 || index >= file_data->size)
+    {
+        return NULL;
+    }
+
+    int64_t row;
+    FileNode *node = find_node(file_data, index, &row);
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+
+    // Compute display line from source line
+    FileLine *data = &file_data->display_line;
+    if (row_bounds(file_data, node, row, &data->col_start, &data->size, &data->visual_start) < 0)
+    {
+        return NULL;
+    }
+
+    data->encoding = line_encoding(file_data, node);
+    data->line = tree_line_index(node);
+    data->endl = row == node->display_rows - 1;
+    data->tabs = node->tabs != 0;
+    data->content = node->content + data->col_start;
+
+    // Bytes of the next display line that may complete the last character
+    int64_t lookahead = node->size - data->col_start - data->size;
+    lookahead = lookahead < FILE_LINE_LOOKAHEAD ? lookahead : FILE_LINE_LOOKAHEAD;
+
+    // Content of the edited line after the gap is shifted
+    if (node == file_data->edit_node && file_data->gap_size > 0 && data->col_start + data->size + lookahead > file_data->gap_start)
+    {
+        if (data->col_start >= file_data->gap_start)
+        {
+            data->content += file_data->gap_size;
+        }
+        else
+        {
+            // Display line crossing the gap is assembled in the display buffer, with the lookahead bytes
+            int64_t size = data->size + lookahead;
+            if (file_data->display_buffer_size < size)
+            {
+                char *buffer = (char*) realloc(file_data->display_buffer, size * sizeof(char));
+                if (buffer == NULL)
+                {
+                    return NULL;
+                }
+
+                file_data->display_buffer = buffer;
+                file_data->display_buffer_size = size;
+            }
+
+            int64_t before = file_data->gap_start - data->col_start;
+            memcpy(file_data->display_buffer, data->content, before * sizeof(char));
+            memcpy(file_data->display_buffer + before, data->content + before + file_data->gap_size, (size - before) * sizeof(char));
+            data->content = file_data->display_buffer;
+        }
+    }
+
+    return data;
+}
+
+int file_data_insert_char(FileData *file_data, int64_t line, int64_t col, char ins)
+{
+    if (file_data == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    if (index_lazy(file_data, line + LAZY_LOAD_MARGIN, -1) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    int64_t source_col;
+    FileNode *node = find_insert_position(file_data, line, col, &source_col);
+
+    if (node == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    set_edit_node(file_data, node);
+    mark_modified(file_data, node, source_col);
+
+    if (ins != '\n')
+    {
+        if (open_gap(file_data, source_col, 1) < 0)
+        {
+            return E_INTERNAL_ERROR;
+        }
+
+        node->content[file_data->gap_start++] = ins;
+        file_data->gap_size--;
+        node->size++;
+
+        if (ins == '\t')
+        {
+            node->tabs = 1;
+        }
+
+        tree_update_size(file_data, node);
+    }
+    else
+    {
+        close_gap(file_data);
+
+        // Pointer to data to be moved
+        int64_t len = node->size - source_col;
+        char *buffer = node->content + source_col;
+
+        // Insert new line (read-only spans are shared, writable content is copied)
+        FileNode *new_node;
+        if (node->capacity == 0)
+        {
+            new_node = insert_span(file_data, node, buffer, len);
+        }
+        else
+        {
+            new_node = insert_node(file_data, node, buffer, len);
+        }
+
+        if (new_node == NULL)
+        {
+            return E_INTERNAL_ERROR;
+        }
+
+        // Remove moved content from line, editing continues on the new line
+        truncate_line(node, source_col);
+        tree_update_size(file_data, node);
+        set_edit_node(file_data, new_node);
+    }
+
+    update_counters(file_data);
+    return E_SUCCESS;
+}
+
+int file_data_insert_buffer(FileData *file_data, int64_t line, int64_t col, const char *buffer, int64_t len)
+{
+    if (file_data == NULL || (buffer == NULL && len != 0) || len < 0)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    if (index_lazy(file_data, line + LAZY_LOAD_MARGIN, -1) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    int64_t source_col;
+    FileNode *node = find_insert_position(file_data, line, col, &source_col);
+
+    if (node == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    // Start of the last line of the buffer
+    const char *last_new_line = len > 0 ? memrchr(buffer, '\n', len) : NULL;
+    int64_t last_start = last_new_line != NULL ? last_new_line + 1 - buffer : -1;
+
+    set_edit_node(file_data, node);
+    mark_modified(file_data, node, source_col);
+
+    // Text without line breaks is written directly into the gap
+    if (last_start == -1)
+    {
+        if (open_gap(file_data, source_col, len) < 0)
+        {
+            return E_INTERNAL_ERROR;
+        }
+
+        memcpy(node->content + file_data->gap_start, buffer, len * sizeof(char));
+        file_data->gap_start += len;
+        file_data->gap_size -= len;
+        node->size += len;
+
+        if (memchr(buffer, '\t', len) != NULL)
+        {
+            node->tabs = 1;
+        }
+
+        tree_update_size(file_data, node);
+        update_counters(file_data);
+        return E_SUCCESS;
+    }
+
+    close_gap(file_data);
+
+    // Inserted text is kept in the append buffer, full lines are read-only spans of it
+    char *text = append_buffer_alloc(file_data, len);
+    if (text == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+    memcpy(text, buffer, len * sizeof(char));
+
+    // Last line is the end of the text followed by the rest of the line
+    int64_t tail_len = node->size - source_col;
+    FileNode *last = insert_node(file_data, node, text + last_start, len - last_start);
+    if (last == NULL || reserve_line(file_data, last, last->size + tail_len + 1) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    memcpy(last->content + last->size, node->content + source_col, tail_len * sizeof(char));
+    last->size += tail_len;
+    last->content[last->size] = '\0';
+    last->tabs = LINE_TABS_UNKNOWN;
+    tree_update_size(file_data, last);
+
+    // Full lines in between
+    char *first_end = memchr(text, '\n', len);
+    char *line_start = first_end + 1;
+    FileNode *prev = node;
+    while (line_start < text + last_start)
+    {
+        char *line_end = memchr(line_start, '\n', text + last_start - line_start);
+
+        prev = insert_span(file_data, prev, line_start, line_end - line_start);
+        if (prev == NULL)
+        {
+            return E_INTERNAL_ERROR;
+        }
+
+        line_start = line_end + 1;
+    }
+
+    // First line is the start of the line followed by the start of the text
+    int64_t first_len = first_end - text;
+    truncate_line(node, source_col);
+    if (reserve_line(file_data, node, source_col + first_len + 1) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    memcpy(node->content + source_col, text, first_len * sizeof(char));
+    truncate_line(node, source_col + first_len);
+    if (memchr(text, '\t', first_len) != NULL)
+    {
+        node->tabs = 1;
+    }
+    tree_update_size(file_data, node);
+
+    // Editing continues at the end of the inserted text
+    set_edit_node(file_data, last);
+    update_counters(file_data);
+    return E_SUCCESS;
+}
+
+int file_data_delete_char(FileData *file_data, int64_t line, int64_t col)
+{
+    if (file_data == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    if (index_lazy(file_data, line + LAZY_LOAD_MARGIN, -1) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    int64_t row;
+    FileNode *node = find_node(file_data, line, &row);
+
+    if (node == NULL || col < -1)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    int64_t col_start, size;
+    if (row_bounds(file_data, node, row, &col_start, &size, NULL) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    if (col >= size)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    int64_t source_col = col_start + col;
+
+    if (source_col == -1)
+    {
+        FileNode *prev = node->prev;
+
+        if (prev == NULL)
+        {
+            return E_INVALID_CHAR;
+        }
+
+        set_edit_node(file_data, prev);
+        mark_modified(file_data, prev, prev->size);
+        close_gap(file_data);
+
+        // Merge with previous line
+        if (reserve_line(file_data, prev, prev->size + node->size + 1) < 0)
+        {
+            return E_INTERNAL_ERROR;
+        }
+
+        memcpy(prev->content + prev->size, node->content, node->size * sizeof(char));
+        prev->size += node->size;
+        prev->content[prev->size] = '\0';
+        if (node->tabs != 0)
+        {
+            prev->tabs = LINE_TABS_UNKNOWN;
+        }
+
+        delete_node(file_data, node);
+        tree_update_size(file_data, prev);
+    }
+    else
+    {
+        // Delete character on line by extending the gap over it
+        set_edit_node(file_data, node);
+        mark_modified(file_data, node, source_col);
+        if (open_gap(file_data, source_col, 0) < 0)
+        {
+            return E_INTERNAL_ERROR;
+        }
+
+        file_data->gap_size++;
+        node->size--;
+        tree_update_size(file_data, node);
+    }
+
+    update_counters(file_data);
+    return E_SUCCESS;
+}
+
+int file_data_delete_range(FileData *file_data, int64_t start_line, int64_t start_col, int64_t stop_line, int64_t stop_col)
+{
+    if (file_data == NULL || start_col < 0 || stop_col < 0)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    if (index_lazy(file_data, -1, stop_line + LAZY_LOAD_MARGIN) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    FileNode *start = find_line_node(file_data, start_line);
+    FileNode *stop = find_line_node(file_data, stop_line);
+
+    if (start == NULL || stop == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    // A column past the end of a line is the start of the next line
+    if (start_col > start->size)
+    {
+        start_col = start->next != NULL ? 0 : start->size;
+        start = start->next != NULL ? start->next : start;
+        start_line++;
+    }
+
+    if (stop_col > stop->size)
+    {
+        stop_col = stop->next != NULL ? 0 : stop->size;
+        stop = stop->next != NULL ? stop->next : stop;
+        stop_line++;
+    }
+
+    if (start_line > stop_line || (start == stop && start_col >= stop_col))
+    {
+        return E_SUCCESS;
+    }
+
+    set_edit_node(file_data, start);
+    mark_modified(file_data, start, start_col);
+
+    // Range inside a line is added to the gap
+    if (start == stop)
+    {
+        if (open_gap(file_data, start_col, 0) < 0)
+        {
+            return E_INTERNAL_ERROR;
+        }
+
+        file_data->gap_size += stop_col - start_col;
+        start->size -= stop_col - start_col;
+        tree_update_size(file_data, start);
+        update_counters(file_data);
+        return E_SUCCESS;
+    }
+
+    close_gap(file_data);
+
+    // Join the start of the first line with the end of the last line
+    int64_t tail_len = stop->size - stop_col;
+    truncate_line(start, start_col);
+    if (reserve_line(file_data, start, start_col + tail_len + 1) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    memcpy(start->content + start_col, stop->content + stop_col, tail_len * sizeof(char));
+    truncate_line(start, start_col + tail_len);
+    if (stop->tabs != 0)
+    {
+        start->tabs = LINE_TABS_UNKNOWN;
+    }
+    tree_update_size(file_data, start);
+
+    // Remove the lines in between and the last line
+    FileNode *c = start->next;
+    while (c != stop)
+    {
+        FileNode *next = c->next;
+        delete_node(file_data, c);
+        c = next;
+    }
+    delete_node(file_data, stop);
+
+    update_counters(file_data);
+    return E_SUCCESS;
+}
+
+int file_data_begin_transaction(FileData *file_data)
+{
+    if (file_data == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    file_data->transaction++;
+    return E_SUCCESS;
+}
+
+int file_data_commit_transaction(FileData *file_data)
+{
+    if (file_data == NULL || file_data->transaction == 0)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    file_data->transaction--;
+
+    if (file_data->transaction == 0)
+    {
+        fit_pending_lines(file_data);
+        update_counters(file_data);
+    }
+
+    return E_SUCCESS;
+}
+
+void file_data_check_integrity(FileData *file_data)
+{
+    // FileData assertions
+    assert(file_data->transaction > 0 || (file_data->current != NULL && file_data->current_index == tree_row_index(file_data, file_data->current)) || (file_data->current_index == -1 && file_data->current == NULL)); // Current node should be part of internal structure (index updated on commit)
+    assert(file_data->size >= 0); // Positive size
+    assert(file_data->display_cols > 0); // Positive non 0 number of display columns
+    assert(file_data->start != NULL); // There is always at least a line to edit
+
+    // Node iteration
+    int64_t count = 0;
+    int64_t rows = 0;
+    int edit_found = 0;
+    FileNode *c = file_data->start;
+    FileNode *prev = NULL;
+
+    while(c != NULL)
+    {
+        // Linked list assertions
+        assert((c == file_data->start && c->prev == NULL) || c->prev != NULL); // Prev navigation if not first node
+        assert((c == file_data->end && c->next == NULL) || c->next != NULL); // Next navigation if not last node
+        assert(c->prev == prev); // Check backward navigation
+
+        // Line assertions
+        assert(tree_line_index(c) == count); // Source line number follows list order
+
+        // - content integrity
+        assert(c->size >= 0); // Positive line size
+        int64_t gap_start = c == file_data->edit_node ? file_data->gap_start : c->size;
+        int64_t gap_size = c == file_data->edit_node ? file_data->gap_size : 0;
+        assert(gap_start >= 0 && gap_start <= c->size && gap_size >= 0); // Gap should be inside the line
+        assert(gap_size == 0 || c->capacity != 0); // Gap should be in a writable slot
+        assert(c->capacity == 0 || c->capacity > c->size + gap_size); // Writable slot should fit the line
+        assert(c == file_data->edit_node || file_data->transaction > 0 || c->capacity == 0 || c->capacity == fit_capacity(c->size)); // Writable slots of lines not being edited should fit the content (shrunk on commit)
+        assert(c->capacity == 0 || c->content[c->size + gap_size] == '\0'); // Writable line content should be null terminated at size
+
+        for (int64_t i = 0; i < c->size; i++)
+        {
+            char ch = c->content[i < gap_start ? i : i + gap_size];
+            assert(ch != '\n'); // No newline characters inside line content
+        }
+        assert(c->encoding == LINE_ENCODING_UNKNOWN || gap_size > 0 || c->encoding == (int) text_encoding(c->content, c->size)); // Known encoding should match the content
+
+        // Next iteration
+        edit_found |= c == file_data->edit_node;
+        // - display lines, also of the cached layout
+        int64_t display_rows = c->tabs != 0 ? scan_row_layout(file_data, c, NULL, NULL) : line_rows(file_data, c->size);
+        FileRowLayout *layout = row_layout_slot(file_data, c);
+        assert(c->display_rows == display_rows); // Display line count of the node should match its content
+        assert(layout == NULL || layout->node != c || layout->rows == display_rows); // Cached layout should match the content
+        assert(c->tabs != 0 || memchr(c->content, '\t', gap_start) == NULL); // Lines without the tabs flag have no tabs
+        assert(c->tabs != 0 || memchr(c->content + gap_start + gap_size, '\t', c->size - gap_start) == NULL);
+        rows += c->display_rows;
+        prev = c;
+        c = c->next;
+        count++;
+    }
+
+    assert(count == file_data->lines); // Number of source lines should correspond with iterated nodes
+    assert(rows == file_data->size); // Number of display lines should correspond with line sizes
+    assert(file_data->end == prev); // Last visited node should be the end one
+
+    // Index tree assertions
+    FileNode *list_node = file_data->start;
+    assert(file_data->root == NULL || file_data->root->parent == NULL); // Root has no parent
+    assert(tree_check_integrity(file_data, file_data->root, &list_node) == file_data->lines); // Tree contains every node
+    assert(list_node == NULL); // Tree order matches list order
+    assert(file_data->root->rows == file_data->size); // Tree display line count matches
+    assert(file_data->edit_node == NULL || edit_found); // Edited node should be part of internal structure
+    assert(file_data->edit_node != NULL || file_data->gap_size == 0); // Gap is only kept in the edited line
+}
+
+int file_data_get_display_coords(FileData *file_data, int64_t source_line, int64_t source_col, int64_t *display_line, int64_t *display_col)
+{
+    if (file_data != NULL && index_lazy(file_data, -1, source_line + LAZY_LOAD_MARGIN) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    if (file_data == NULL || display_line == NULL || display_col == NULL || source_line < 0 || source_line >= file_data->lines)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    FileNode* node = find_line_node(file_data, source_line);
+
+    if (node == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    // source column greater than source line length
+    if (source_col == -1 || source_col > node->size)
+    {
+        source_col = node->size;
+    }
+
+    // A column on a display line boundary is shown at the end of the previous display line
+    int64_t row = col_row(file_data, node, source_col);
+    int64_t col_start, size;
+    if (row < 0 || row_bounds(file_data, node, row, &col_start, &size, NULL) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    *display_line = tree_row_index(file_data, node) + row;
+    *display_col = source_col - col_start;
+    return E_SUCCESS;
+}
+
+int file_data_get_source_coords(FileData *file_data, int64_t display_line, int64_t display_col, int64_t *source_line, int64_t *source_col)
+{
+    if (file_data == NULL || source_line == NULL || source_col == NULL || display_col < 0)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    if (index_lazy(file_data, display_line + LAZY_LOAD_MARGIN, -1) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    int64_t row;
+    FileNode *node = find_node(file_data, display_line, &row);
+
+    if (node == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    int64_t col_start, size;
+    if (row_bounds(file_data, node, row, &col_start, &size, NULL) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    *source_line = tree_line_index(node);
+    *source_col = col_start + display_col;
+    return E_SUCCESS;
+}
+
+int file_data_align_char(FileData *file_data, int64_t source_line, int64_t source_col, int forward, int64_t *aligned_col)
+{
+    if (file_data != NULL && index_lazy(file_data, -1, source_line + LAZY_LOAD_MARGIN) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    if (file_data == NULL || aligned_col == NULL || source_line < 0 || source_line >= file_data->lines)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    FileNode *node = find_line_node(file_data, source_line);
+
+    if (node == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    *aligned_col = source_col;
+    if (source_col <= 0 || source_col >= node->size || line_encoding(file_data, node) != FILE_LINE_UTF8)
+    {
+        return E_SUCCESS;
+    }
+
+    // Continuation bytes are skipped, the content after the gap of the edited line is shifted
+    int64_t gap_start = node == file_data->edit_node ? file_data->gap_start : node->size;
+    int64_t gap_size = node == file_data->edit_node ? file_data->gap_size : 0;
+    int step = forward ? 1 : -1;
+
+    while (*aligned_col > 0 && *aligned_col < node->size)
+    {
+        unsigned char ch = node->content[*aligned_col < gap_start ? *aligned_col : *aligned_col + gap_size];
+        if ((ch & 0xC0) != 0x80)
+        {
+            break;
+        }
+        *aligned_col += step;
+    }
+
+    return E_SUCCESS;
+}
+
+int file_data_get_visual_col(FileData *file_data, int64_t source_line, int64_t source_col, int64_t *visual_col)
+{
+    if (file_data != NULL && index_lazy(file_data, -1, source_line + LAZY_LOAD_MARGIN) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    if (file_data == NULL || visual_col == NULL || source_line < 0 || source_line >= file_data->lines)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    FileNode *node = find_line_node(file_data, source_line);
+
+    if (node == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    if (source_col < 0 || source_col > node->size)
+    {
+        source_col = node->size;
+    }
+
+    if (node->tabs == 0)
+    {
+        *visual_col = source_col;
+        return E_SUCCESS;
+    }
+
+    // Scan from the display line of the column
+    int64_t row = col_row(file_data, node, source_col);
+    int64_t col, size, x;
+    if (row < 0 || row_bounds(file_data, node, row, &col, &size, &x) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    for (; col < source_col; col++)
+    {
+        x += line_byte(file_data, node, col) == '\t' ? FILE_DATA_TAB_SIZE - x % FILE_DATA_TAB_SIZE : 1;
+    }
+
+    *visual_col = x;
+    return E_SUCCESS;
+}
+
+int file_data_get_visual_source_col(FileData *file_data, int64_t source_line, int64_t visual_col, int64_t *source_col)
+{
+    if (file_data != NULL && index_lazy(file_data, -1, source_line + LAZY_LOAD_MARGIN) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    if (file_data == NULL || source_col == NULL || source_line < 0 || source_line >= file_data->lines || visual_col < 0)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    FileNode *node = find_line_node(file_data, source_line);
+
+    if (node == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    if (node->tabs == 0)
+    {
+        *source_col = visual_col < node->size ? visual_col : node->size;
+        return E_SUCCESS;
+    }
+
+    FileRowLayout *layout = row_layout(file_data, node);
+    if (layout == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    // Last display line starting at or before the visual column
+    int64_t low = 0, high = layout->rows - 1;
+    while (low < high)
+    {
+        int64_t mid = (low + high + 1) / 2;
+        if (layout->visual[mid] <= visual_col)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    // A column inside a tab is mapped to the tab
+    int64_t col = layout->starts[low], x = layout->visual[low];
+    while (col < node->size)
+    {
+        x += line_byte(file_data, node, col) == '\t' ? FILE_DATA_TAB_SIZE - x % FILE_DATA_TAB_SIZE : 1;
+        if (x > visual_col)
+        {
+            break;
+        }
+        col++;
+    }
+
+    *source_col = col;
+    return E_SUCCESS;
+}
+
+int file_data_get_memory_stats(FileData *file_data, FileDataMemoryStats *stats)
+{
+    if (file_data == NULL || stats == NULL)
+    {
+        return E_INVALID_ARGS;
+    }
+
+    // Only the decompressed part of the range reserved for a gzip file is in use
+    int64_t original_size = file_data->original_size;
+    if (file_data->loader != NULL && file_data->compression == FILE_DATA_COMPRESSION_GZIP)
+    {
+        pthread_mutex_lock(&file_data->loader->lock);
+        original_size = file_data->loader->bytes_read;
+        pthread_mutex_unlock(&file_data->loader->lock);
+    }
+
+    int mapped = file_data->original_mapped && file_data->compression == FILE_DATA_COMPRESSION_NONE;
+    stats->lines = file_data->lines;
+    stats->text_bytes = 0;
+    stats->slot_bytes = 0;
+    stats->original_bytes = mapped ? 0 : original_size;
+    stats->mapped_bytes = mapped ? original_size : 0;
+    stats->append_bytes = 0;
+    stats->node_bytes = 0;
+
+    int64_t mapped_text = 0;
+    for (FileNode *c = file_data->start; c != NULL; c = c->next)
+    {
+        stats->text_bytes += c->size;
+        stats->slot_bytes += c->capacity;
+
+        if (mapped && c->content >= file_data->original && c->content < file_data->original + original_size)
+        {
+            mapped_text += c->size;
+        }
+    }
+
+    for (FileBuffer *chunk = file_data->append; chunk != NULL; chunk = chunk->next)
+    {
+        stats->append_bytes += sizeof(FileBuffer) + chunk->capacity;
+    }
+
+    for (FileNodeChunk *chunk = file_data->node_chunks; chunk != NULL; chunk = chunk->next)
+    {
+        stats->node_bytes += sizeof(FileNodeChunk) + NODE_CHUNK_SIZE * sizeof(FileNode);
+    }
+
+    stats->cache_bytes = file_data->display_buffer_size;
+    if (file_data->row_layouts != NULL)
+    {
+        stats->cache_bytes += ROW_LAYOUT_CACHE_SIZE * sizeof(FileRowLayout);
+        for (int i = 0; i < ROW_LAYOUT_CACHE_SIZE; i++)
+        {
+            stats->cache_bytes += 2 * file_data->row_layouts[i].capacity * sizeof(int64_t);
+        }
+    }
+
+    // Line lengths read from the sidecar file fill their buffer, the ones of a new cache grow it
+    FileLineIndex *line_index = file_data->line_index;
+    if (line_index != NULL)
+    {
+        int64_t data_size = line_index->capacity > line_index->size ? line_index->capacity : line_index->size;
+        stats->cache_bytes += sizeof(FileLineIndex) + data_size + (line_index->path != NULL ? strlen(line_index->path) + 1 : 0);
+    }
+
+    stats->total_bytes = sizeof(FileData) + stats->original_bytes + stats->append_bytes + stats->node_bytes + stats->cache_bytes;
+    stats->overhead_per_line = stats->lines > 0 ? (double) (stats->total_bytes - stats->text_bytes + mapped_text) / stats->lines : 0;
+    return E_SUCCESS;
+}
+
+
+// ------------------------- Private functions definitions -------------------------
+
+static FileNode* insert_node(FileData *file_data, FileNode *node, char *content_buffer, int64_t len)
+{
+    if (file_data == NULL || (content_buffer == NULL && len != 0))
+    {
+        return NULL;
+    }
+
+    // Allocate writable slot for content
+    int64_t capacity = len + 1;
+    char *content = alloc_slot(file_data, &capacity);
+
+    if (content == NULL)
+    {
+        return NULL;
+    }
+
+    // Copy data from buffer into new line
+    if (len > 0)
+    {
+        memcpy(content, content_buffer, len * sizeof(char));
+    }
+    content[len] = '\0';
+
+    FileNode *new_node = insert_span(file_data, node, content, len);
+
+    if (new_node == NULL)
+    {
+        release_slot(file_data, content, capacity);
+        return NULL;
+    }
+
+    new_node->capacity = capacity;
+    return new_node;
+}
+
+static FileNode* insert_span(FileData *file_data, FileNode *node, char *span, int64_t len)
+{
+    if (file_data == NULL || (span == NULL && len != 0))
+    {
+        return NULL;
+    }
+
+    FileNode *new_node = link_node(file_data, node);
+
+    if (new_node == NULL)
+    {
+        return NULL;
+    }
+
+    new_node->content = span;
+    new_node->size = len;
+    tree_update_size(file_data, new_node);
+    update_counters(file_data);
+    return new_node;
+}
+
+static FileNode* link_node(FileData *file_data, FileNode *node)
+{
+    // Allocate memory for node
+    FileNode *new_node = alloc_node(file_data);
+
+    if (new_node == NULL)
+    {
+        return NULL;
+    }
+
+    // Initialize node data
+    new_node->content = NULL;
+    new_node->size = 0;
+    new_node->capacity = 0;
+    new_node->encoding = LINE_ENCODING_UNKNOWN;
+    new_node->tabs = LINE_TABS_UNKNOWN;
+    new_node->display_rows = 1;
+    drop_row_layout(file_data, new_node);
+
+    // Update linked list structure
+    new_node->next = node != NULL ? node->next : file_data->start;
+    new_node->prev = node;
+
+    // If the node to be inserted is not the last one
+    if (new_node->next != NULL)
+    {
+        new_node->next->prev = new_node;
+    }
+    else
+    {
+        file_data->end = new_node;
+    }
+
+    // If the node to be inserted is not the first one
+    if (node != NULL)
+    {
+        node->next = new_node;
+    }
+    else
+    {
+        file_data->start = new_node;
+    }
+
+    // Update index tree
+    tree_insert(file_data, new_node);
+
+    return new_node;
+}
+
+static void delete_node(FileData *file_data, FileNode *node)
+{
+    if (node == NULL || file_data == NULL)
+    {
+        return;
+    }
+
+    // Unlink node from index tree (list links are still needed for its position)
+    tree_remove(file_data, node);
+
+    // If the node to be deleted is the start node
+    if (node->prev == NULL)
+    {
+        file_data->start = node->next;
+        if (file_data->start != NULL)
+        {
+            file_data->start->prev = NULL;
+        }
+    }
+    else
+    {
+        node->prev->next = node->next;
+    }
+
+    // If the node to be deleted is the last node
+    if (node->next == NULL)
+    {
+        file_data->end = node->prev;
+        if (file_data->end != NULL)
+        {
+            file_data->end->next = NULL;
+        }
+    }
+    else
+    {
+        node->next->prev = node->prev;
+    }
+
+    if (file_data->edit_node == node)
+    {
+        file_data->edit_node = NULL;
+        file_data->gap_start = 0;
+        file_data->gap_size = 0;
+    }
+
+    // Remove deleted node from the lines to be shrunk on commit
+    for (int i = 0; i < file_data->pending_count; i++)
+    {
+        if (file_data->pending_lines[i] == node)
+        {
+            file_data->pending_lines[i--] = file_data->pending_lines[--file_data->pending_count];
+        }
+    }
+
+    // Update the current pointer if it points to the node being deleted
+    if (file_data->current == node)
+    {
+        file_data->current = node->next != NULL ? node->next : node->prev;
+    }
+
+    update_counters(file_data);
+
+    // Release deleted node and its writable slot
+    release_slot(file_data, node->content, node->capacity);
+    release_node(file_data, node);
+}
+
+static FileNode* find_node(const FileData *file_data, int64_t index, int64_t *row)
+{
+    // Ensure the index is within bounds
+    if (file_data == NULL || index < 0 || index >= file_data->size)
+    {
+        return NULL;
+    }
+
+    // Descend the index tree using subtree display line counts
+    FileNode *node = file_data->root;
+    while (node != NULL)
+    {
+        int64_t left_rows = node->left != NULL ? node->left->rows : 0;
+        int64_t node_rows = node->display_rows;
+
+        if (index < left_rows)
+        {
+            node = node->left;
+        }
+        else if (index >= left_rows + node_rows)
+        {
+            index -= left_rows + node_rows;
+            node = node->right;
+        }
+        else
+        {
+            index -= left_rows;
+            break;
+        }
+    }
+
+    if (row != NULL)
+    {
+        *row = index;
+    }
+
+    return node;
+}
+
+static FileNode* find_insert_position(FileData *file_data, int64_t line, int64_t col, int64_t *source_col)
+{
+    int64_t row;
+    FileNode *node = find_node(file_data, line, &row);
+
+    if (node == NULL || col < 0)
+    {
+        return NULL;
+    }
+
+    int64_t col_start, size;
+    if (row_bounds(file_data, node, row, &col_start, &size, NULL) < 0)
+    {
+        return NULL;
+    }
+
+    // Edge case for inserting at the end of a source file line
+    int endl = row == node->display_rows - 1;
+    int64_t max_col = endl ? size : size - 1;
+    if (col > max_col)
+    {
+        return NULL;
+    }
+
+    *source_col = col_start + col;
+    return node;
+}
+
+static FileNode* find_line_node(const FileData *file_data, int64_t index)
+{
+    if (file_data == NULL || index < 0 || index >= file_data->lines)
+    {
+        return NULL;
+    }
+
+    // Descend the index tree using subtree node counts
+    FileNode *node = file_data->root;
+    while (node != NULL)
+    {
+        int64_t left_weight = node->left != NULL ? node->left->weight : 0;
+
+        if (index < left_weight)
+        {
+            node = node->left;
+        }
+        else if (index > left_weight)
+        {
+            index -= left_weight + 1;
+            node = node->right;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return node;
+}
+
+static int64_t line_rows(const FileData *file_data, int64_t size)
+{
+    if (size == 0)
+    {
+        return 1;
+    }
+
+    return (size + file_data->display_cols - 1) / file_data->display_cols;
+}
+
+static void update_display_rows(FileData *file_data, FileNode *node)
+{
+    drop_row_layout(file_data, node);
+    node->display_rows = line_tabs(file_data, node) ? scan_row_layout(file_data, node, NULL, NULL) : line_rows(file_data, node->size);
+}
+
+static int line_tabs(FileData *file_data, FileNode *node)
+{
+    if (node->tabs != LINE_TABS_UNKNOWN)
+    {
+        return node->tabs;
+    }
+
+    // Content of the edited line after the gap is shifted
+    int64_t gap_start = node == file_data->edit_node ? file_data->gap_start : node->size;
+    int64_t gap_size = node == file_data->edit_node ? file_data->gap_size : 0;
+    node->tabs = memchr(node->content, '\t', gap_start) != NULL ||
+        memchr(node->content + gap_start + gap_size, '\t', node->size - gap_start) != NULL;
+    return node->tabs;
+}
+
+static char line_byte(const FileData *file_data, const FileNode *node, int64_t col)
+{
+    if (node == file_data->edit_node && col >= file_data->gap_start)
+    {
+        return node->content[col + file_data->gap_size];
+    }
+
+    return node->content[col];
+}
+
+static int64_t scan_row_layout(const FileData *file_data, const FileNode *node, int64_t *starts, int64_t *visual)
+{
+    int64_t rows = 1, row_visual = 0, x = 0;
+    if (starts != NULL)
+    {
+        starts[0] = 0;
+        visual[0] = 0;
+    }
+
+    // Tab stops are counted from the start of the source line
+    int64_t row_start = 0;
+    for (int64_t col = 0; col < node->size; col++)
+    {
+        int64_t width = line_byte(file_data, node, col) == '\t' ? FILE_DATA_TAB_SIZE - x % FILE_DATA_TAB_SIZE : 1;
+        if (col > row_start && x + width - row_visual > file_data->display_cols)
+        {
+            if (starts != NULL)
+            {
+                starts[rows] = col;
+                visual[rows] = x;
+            }
+
+            rows++;
+            row_start = col;
+            row_visual = x;
+        }
+
+        x += width;
+    }
+
+    return rows;
+}
+
+static FileRowLayout* row_layout(FileData *file_data, FileNode *node)
+{
+    if (file_data->row_layouts == NULL)
+    {
+        file_data->row_layouts = (FileRowLayout*) calloc(ROW_LAYOUT_CACHE_SIZE, sizeof(FileRowLayout));
+        if (file_data->row_layouts == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    FileRowLayout *layout = row_layout_slot(file_data, node);
+    if (layout->node == node)
+    {
+        return layout;
+    }
+
+    // Entry is taken over by this line
+    layout->node = NULL;
+    int64_t rows = node->display_rows;
+    if (layout->capacity < rows)
+    {
+        int64_t *starts = (int64_t*) realloc(layout->starts, rows * sizeof(int64_t));
+        if (starts == NULL)
+        {
+            return NULL;
+        }
+        layout->starts = starts;
+
+        int64_t *visual = (int64_t*) realloc(layout->visual, rows * sizeof(int64_t));
+        if (visual == NULL)
+        {
+            return NULL;
+        }
+        layout->visual = visual;
+        layout->capacity = rows;
+    }
+
+    layout->rows = scan_row_layout(file_data, node, layout->starts, layout->visual);
+    layout->node = node;
+    return layout;
+}
+
+static FileRowLayout* row_layout_slot(const FileData *file_data, const FileNode *node)
+{
+    if (file_data->row_layouts == NULL)
+    {
+        return NULL;
+    }
+
+    return &file_data->row_layouts[((uintptr_t) node / sizeof(FileNode)) % ROW_LAYOUT_CACHE_SIZE];
+}
+
+static void drop_row_layout(FileData *file_data, const FileNode *node)
+{
+    FileRowLayout *layout = row_layout_slot(file_data, node);
+    if (layout != NULL && layout->node == node)
+    {
+        layout->node = NULL;
+    }
+}
+
+static void clear_row_layouts(FileData *file_data, int release)
+{
+    if (file_data->row_layouts == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < ROW_LAYOUT_CACHE_SIZE; i++)
+    {
+        FileRowLayout *layout = &file_data->row_layouts[i];
+        layout->node = NULL;
+
+        if (release)
+        {
+            free(layout->starts);
+            free(layout->visual);
+        }
+    }
+
+    if (release)
+    {
+        free(file_data->row_layouts);
+        file_data->row_layouts = NULL;
+    }
+}
+
+static int row_bounds(FileData *file_data, FileNode *node, int64_t row, int64_t *col_start, int64_t *size, int64_t *visual_start)
+{
+    // Lines without tabs are split every display_cols bytes
+    if (node->tabs == 0)
+    {
+        *col_start = row * file_data->display_cols;
+        *size = node->size - *col_start < file_data->display_cols ? node->size - *col_start : file_data->display_cols;
+        if (visual_start != NULL)
+        {
+            *visual_start = *col_start;
+        }
+        return E_SUCCESS;
+    }
+
+    FileRowLayout *layout = row_layout(file_data, node);
+    if (layout == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    *col_start = layout->starts[row];
+    *size = (row + 1 < layout->rows ? layout->starts[row + 1] : node->size) - *col_start;
+    if (visual_start != NULL)
+    {
+        *visual_start = layout->visual[row];
+    }
+    return E_SUCCESS;
+}
+
+static int64_t col_row(FileData *file_data, FileNode *node, int64_t col)
+{
+    if (col <= 0)
+    {
+        return 0;
+    }
+
+    if (node->tabs == 0)
+    {
+        return (col - 1) / file_data->display_cols;
+    }
+
+    FileRowLayout *layout = row_layout(file_data, node);
+    if (layout == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    // Last display line starting before the column
+    int64_t low = 0, high = layout->rows - 1;
+    while (low < high)
+    {
+        int64_t mid = (low + high + 1) / 2;
+        if (layout->starts[mid] < col)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    return low;
+}
+
+static void update_counters(FileData *file_data)
+{
+    file_data->size = file_data->root != NULL ? file_data->root->rows : 0;
+    file_data->lines = file_data->root != NULL ? file_data->root->weight : 0;
+
+    // Current node may have been shifted (updated on commit inside a transaction)
+    if (file_data->transaction == 0)
+    {
+        file_data->current_index = file_data->current != NULL ? tree_row_index(file_data, file_data->current) : -1;
+    }
+}
+
+static void tree_insert(FileData *file_data, FileNode *node)
+{
+    node->left = NULL;
+    node->right = NULL;
+    node->priority = next_priority(file_data);
+    tree_update(file_data, node);
+
+    // Attach the node as a leaf next to its in order neighbour
+    if (node->prev == NULL)
+    {
+        node->parent = node->next;
+        if (node->next != NULL)
+        {
+            node->next->left = node;
+        }
+        else
+        {
+            file_data->root = node;
+        }
+    }
+    else if (node->prev->right == NULL)
+    {
+        node->parent = node->prev;
+        node->prev->right = node;
+    }
+    else
+    {
+        // The successor is the leftmost node in the right subtree of the predecessor
+        node->parent = node->next;
+        node->next->left = node;
+    }
+
+    tree_update_path(file_data, node->parent);
+
+    // Restore heap order
+    while (node->parent != NULL && node->parent->priority < node->priority)
+    {
+        tree_rotate_up(file_data, node);
+    }
+}
+
+static void tree_append(FileData *file_data, FileNode *first)
+{
+    if (first == NULL)
+    {
+        return;
+    }
+
+    for (FileNode *node = first; node != NULL; node = node->next)
+    {
+        // The previous node is the bottom of the right spine, climb until heap order holds
+        FileNode *parent = node->prev;
+        FileNode *left = NULL;
+        while (parent != NULL && parent->priority < node->priority)
+        {
+            // Subtree of a node moved off the spine changed if it contains appended nodes
+            if (parent->right != NULL && parent->right->weight == 0)
+            {
+                parent->weight = 0;
+            }
+
+            left = parent;
+            parent = parent->parent;
+        }
+
+        node->left = left;
+        node->right = NULL;
+        node->parent = parent;
+        if (left != NULL)
+        {
+            left->parent = node;
+        }
+
+        if (parent != NULL)
+        {
+            parent->right = node;
+        }
+        else
+        {
+            file_data->root = node;
+        }
+    }
+
+    // Appended and moved nodes (weight 0) form the right subtree of the lowest indexed node left on the spine
+    FileNode *top = file_data->end;
+    while (top->parent != NULL && top->parent->weight == 0)
+    {
+        top = top->parent;
+    }
+
+    tree_update_appended(file_data, top);
+    tree_update_path(file_data, top->parent);
+}
+
+static void tree_update_appended(FileData *file_data, FileNode *node)
+{
+    if (node == NULL || node->weight != 0)
+    {
+        return;
+    }
+
+    tree_update_appended(file_data, node->left);
+    tree_update_appended(file_data, node->right);
+    update_display_rows(file_data, node);
+    tree_update(file_data, node);
+}
+
+static void tree_remove(FileData *file_data, FileNode *node)
+{
+    // Rotate the node down until it has at most one child
+    while (node->left != NULL && node->right != NULL)
+    {
+        FileNode *child = node->left->priority > node->right->priority ? node->left : node->right;
+        tree_rotate_up(file_data, child);
+    }
+
+    FileNode *child = node->left != NULL ? node->left : node->right;
+    FileNode *parent = node->parent;
+
+    if (child != NULL)
+    {
+        child->parent = parent;
+    }
+
+    if (parent == NULL)
+    {
+        file_data->root = child;
+    }
+    else if (parent->left == node)
+    {
+        parent->left = child;
+    }
+    else
+    {
+        parent->right = child;
+    }
+
+    tree_update_path(file_data, parent);
+
+    node->parent = NULL;
+    node->left = NULL;
+    node->right = NULL;
+}
+
+static void tree_rotate_up(FileData *file_data, FileNode *node)
+{
+    FileNode *parent = node->parent;
+    FileNode *grandparent = parent->parent;
+
+    if (parent->left == node)
+    {
+        parent->left = node->right;
+        if (node->right != NULL)
+        {
+            node->right->parent = parent;
+        }
+        node->right = parent;
+    }
+    else
+    {
+        parent->right = node->left;
+        if (node->left != NULL)
+        {
+            node->left->parent = parent;
+        }
+        node->left = parent;
+    }
+
+    parent->parent = node;
+    node->parent = grandparent;
+
+    if (grandparent == NULL)
+    {
+        file_data->root = node;
+    }
+    else if (grandparent->left == parent)
+    {
+        grandparent->left = node;
+    }
+    else
+    {
+        grandparent->right = node;
+    }
+
+    tree_update(file_data, parent);
+    tree_update(file_data, node);
+}
+
+static void tree_update(const FileData *file_data, FileNode *node)
+{
+    node->weight = 1;
+    node->rows = node->display_rows;
+
+    if (node->left != NULL)
+    {
+        node->weight += node->left->weight;
+        node->rows += node->left->rows;
+    }
+
+    if (node->right != NULL)
+    {
+        node->weight += node->right->weight;
+        node->rows += node->right->rows;
+    }
+}
+
+static void tree_update_path(FileData *file_data, FileNode *node)
+{
+    for (FileNode *c = node; c != NULL; c = c->parent)
+    {
+        tree_update(file_data, c);
+    }
+}
+
+static void tree_update_size(FileData *file_data, FileNode *node)
+{
+    int64_t old_rows = node->display_rows;
+    update_display_rows(file_data, node);
+    int64_t delta = node->display_rows - old_rows;
+
+    if (delta == 0)
+    {
+        return;
+    }
+
+    for (FileNode *c = node; c != NULL; c = c->parent)
+    {
+        c->rows += delta;
+    }
+}
+
+static void tree_update_all(FileData *file_data, FileNode *node)
+{
+    if (node == NULL)
+    {
+        return;
+    }
+
+    tree_update_all(file_data, node->left);
+    tree_update_all(file_data, node->right);
+    update_display_rows(file_data, node);
+    tree_update(file_data, node);
+}
+
+static int64_t tree_row_index(const FileData *file_data, const FileNode *node)
+{
+    int64_t index = node->left != NULL ? node->left->rows : 0;
+
+    for (const FileNode *c = node; c->parent != NULL; c = c->parent)
+    {
+        if (c->parent->right == c)
+        {
+            const FileNode *parent = c->parent;
+            index += (parent->left != NULL ? parent->left->rows : 0) + parent->display_rows;
+        }
+    }
+
+    return index;
+}
+
+static int64_t tree_line_index(const FileNode *node)
+{
+    int64_t index = node->left != NULL ? node->left->weight : 0;
+
+    for (const FileNode *c = node; c->parent != NULL; c = c->parent)
+    {
+        if (c->parent->right == c)
+        {
+            index += (c->parent->left != NULL ? c->parent->left->weight : 0) + 1;
+        }
+    }
+
+    return index;
+}
+
+static int64_t tree_check_integrity(const FileData *file_data, FileNode *node, FileNode **list_node)
+{
+    if (node == NULL)
+    {
+        return 0;
+    }
+
+    assert(node->left == NULL || (node->left->parent == node && node->left->priority <= node->priority)); // Left child links back and keeps heap order
+    assert(node->right == NULL || (node->right->parent == node && node->right->priority <= node->priority)); // Right child links back and keeps heap order
+
+    int64_t weight = tree_check_integrity(file_data, node->left, list_node);
+
+    assert(node == *list_node); // In order traversal should follow the linked list
+    *list_node = (*list_node)->next;
+
+    weight += 1 + tree_check_integrity(file_data, node->right, list_node);
+
+    int64_t rows = node->display_rows;
+    rows += node->left != NULL ? node->left->rows : 0;
+    rows += node->right != NULL ? node->right->rows : 0;
+
+    assert(node->weight == weight); // Subtree weight should be up to date
+    assert(node->rows == rows); // Subtree display line count should be up to date
+    return weight;
+}
+
+static unsigned int next_priority(FileData *file_data)
+{
+    return next_random(&file_data->seed);
+}
+
+static unsigned int next_random(unsigned int *state)
+{
+    // xorshift32 generator
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static int reserve_line(FileData *file_data, FileNode *node, int64_t capacity)
+{
+    if (node->capacity >= capacity)
+    {
+        return E_SUCCESS;
+    }
+
+    // Size classes make slots of edited lines grow geometrically
+    char *content = alloc_slot(file_data, &capacity);
+    if (content == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    if (node->size > 0)
+    {
+        memcpy(content, node->content, node->size * sizeof(char));
+    }
+    content[node->size] = '\0';
+
+    release_slot(file_data, node->content, node->capacity);
+    node->content = content;
+    node->capacity = capacity;
+    return E_SUCCESS;
+}
+
+static void set_edit_node(FileData *file_data, FileNode *node)
+{
+    if (file_data->edit_node != node)
+    {
+        close_gap(file_data);
+
+        // Inside a transaction the line is shrunk on commit, as it may be edited again
+        if (file_data->transaction > 0 && file_data->edit_node != NULL)
+        {
+            if (file_data->pending_count == FILE_DATA_PENDING_LINES)
+            {
+                fit_pending_lines(file_data);
+            }
+
+            file_data->pending_lines[file_data->pending_count++] = file_data->edit_node;
+        }
+        else
+        {
+            fit_line(file_data, file_data->edit_node);
+        }
+
+        file_data->edit_node = node;
+        file_data->gap_start = 0;
+        file_data->gap_size = 0;
+    }
+}
+
+static void mark_modified(FileData *file_data, FileNode *node, int64_t col)
+{
+    node->encoding = LINE_ENCODING_UNKNOWN;
+    drop_row_layout(file_data, node);
+
+    int64_t line = tree_line_index(node);
+    if (line < file_data->modified_line || (line == file_data->modified_line && col < file_data->modified_col))
+    {
+        file_data->modified_line = line;
+        file_data->modified_col = col;
+    }
+}
+
+static int open_gap(FileData *file_data, int64_t pos, int64_t len)
+{
+    FileNode *node = file_data->edit_node;
+
+    if (node->capacity != 0 && file_data->gap_size >= len)
+    {
+        // Move the gap, only the characters between the old and the new position are moved
+        if (pos < file_data->gap_start)
+        {
+            memmove(node->content + pos + file_data->gap_size, node->content + pos, (file_data->gap_start - pos) * sizeof(char));
+        }
+        else
+        {
+            memmove(node->content + file_data->gap_start, node->content + file_data->gap_start + file_data->gap_size, (pos - file_data->gap_start) * sizeof(char));
+        }
+
+        file_data->gap_start = pos;
+        return E_SUCCESS;
+    }
+
+    close_gap(file_data);
+
+    // Gap takes all the free space of the slot, which grows geometrically when full
+    if (node->capacity < node->size + len + 1)
+    {
+        int64_t capacity = node->size + len + 1;
+        char *content = alloc_slot(file_data, &capacity);
+        if (content == NULL)
+        {
+            return E_INTERNAL_ERROR;
+        }
+
+        int64_t gap_size = capacity - node->size - 1;
+        memcpy(content, node->content, pos * sizeof(char));
+        memcpy(content + pos + gap_size, node->content + pos, (node->size - pos) * sizeof(char));
+        content[node->size + gap_size] = '\0';
+
+        release_slot(file_data, node->content, node->capacity);
+        node->content = content;
+        node->capacity = capacity;
+    }
+    else
+    {
+        memmove(node->content + node->capacity - (node->size - pos) - 1, node->content + pos, (node->size - pos + 1) * sizeof(char));
+    }
+
+    file_data->gap_start = pos;
+    file_data->gap_size = node->capacity - node->size - 1;
+    return E_SUCCESS;
+}
+
+static void close_gap(FileData *file_data)
+{
+    FileNode *node = file_data->edit_node;
+
+    if (node != NULL && file_data->gap_size > 0)
+    {
+        memmove(node->content + file_data->gap_start, node->content + file_data->gap_start + file_data->gap_size, (node->size - file_data->gap_start) * sizeof(char));
+        node->content[node->size] = '\0';
+    }
+
+    file_data->gap_start = 0;
+    file_data->gap_size = 0;
+}
+
+static void fit_pending_lines(FileData *file_data)
+{
+    for (int i = 0; i < file_data->pending_count; i++)
+    {
+        if (file_data->pending_lines[i] != file_data->edit_node)
+        {
+            fit_line(file_data, file_data->pending_lines[i]);
+        }
+    }
+
+    file_data->pending_count = 0;
+}
+
+static void fit_line(FileData *file_data, FileNode *node)
+{
+    if (node == NULL || node->capacity == 0 || node->capacity == fit_capacity(node->size))
+    {
+        return;
+    }
+
+    // Short lines use the smallest size class, so their slots can be reused
+    int64_t capacity = fit_capacity(node->size);
+    char *content;
+    if (capacity == 1 << MIN_SLOT_CLASS)
+    {
+        content = alloc_slot(file_data, &capacity);
+    }
+    else
+    {
+        content = append_buffer_alloc(file_data, capacity);
+    }
+
+    // On allocation failure the line keeps its larger slot
+    if (content == NULL)
+    {
+        return;
+    }
+
+    memcpy(content, node->content, (node->size + 1) * sizeof(char));
+    release_slot(file_data, node->content, node->capacity);
+    node->content = content;
+    node->capacity = capacity;
+}
+
+static int64_t fit_capacity(int64_t size)
+{
+    return size + 1 > 1 << MIN_SLOT_CLASS ? size + 1 : 1 << MIN_SLOT_CLASS;
+}
+
+static void truncate_line(FileNode *node, int64_t len)
+{
+    node->size = len;
+
+    if (node->capacity != 0)
+    {
+        node->content[len] = '\0';
+    }
+}
+
+static FileNode* alloc_node(FileData *file_data)
+{
+    // Reuse released node
+    if (file_data->free_nodes != NULL)
+    {
+        FileNode *node = file_data->free_nodes;
+        file_data->free_nodes = node->next;
+        return node;
+    }
+
+    return alloc_pool_node(&file_data->node_chunks);
+}
+
+static FileNode* alloc_pool_node(FileNodeChunk **node_chunks)
+{
+    // Start a new chunk if the current one is full
+    FileNodeChunk *chunk = *node_chunks;
+    if (chunk == NULL || chunk->size == NODE_CHUNK_SIZE)
+    {
+        chunk = (FileNodeChunk*) malloc(sizeof(FileNodeChunk) + NODE_CHUNK_SIZE * sizeof(FileNode));
+
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+
+        chunk->next = *node_chunks;
+        chunk->size = 0;
+        *node_chunks = chunk;
+    }
+
+    return &chunk->nodes[chunk->size++];
+}
+
+static void release_node(FileData *file_data, FileNode *node)
+{
+    drop_row_layout(file_data, node);
+    node->next = file_data->free_nodes;
+    file_data->free_nodes = node;
+}
+
+static char* alloc_slot(FileData *file_data, int64_t *capacity)
+{
+    int class = slot_class(*capacity);
+    if (class < 0)
+    {
+        return NULL;
+    }
+
+    *capacity = (int64_t) 1 << class;
+
+    // Reuse released slot of the same class (the free list link is stored in the slot)
+    char *slot = file_data->free_slots[class];
+    if (slot != NULL)
+    {
+        memcpy(&file_data->free_slots[class], slot, sizeof(char*));
+        return slot;
+    }
+
+    return append_buffer_alloc(file_data, *capacity);
+}
+
+static void release_slot(FileData *file_data, char *slot, int64_t capacity)
+{
+    // Read-only spans are not owned by the node
+    if (capacity == 0)
+    {
+        return;
+    }
+
+    // Largest class the slot can hold
+    int class = MIN_SLOT_CLASS - 1;
+    while (class + 1 < FILE_DATA_SLOT_CLASSES && ((int64_t) 1 << (class + 1)) <= capacity)
+    {
+        class++;
+    }
+
+    if (class < MIN_SLOT_CLASS)
+    {
+        return;
+    }
+
+    memcpy(slot, &file_data->free_slots[class], sizeof(char*));
+    file_data->free_slots[class] = slot;
+}
+
+static int slot_class(int64_t capacity)
+{
+    int class = MIN_SLOT_CLASS;
+    while (class < FILE_DATA_SLOT_CLASSES && ((int64_t) 1 << class) < capacity)
+    {
+        class++;
+    }
+
+    return class < FILE_DATA_SLOT_CLASSES ? class : -1;
+}
+
+static char* append_buffer_alloc(FileData *file_data, int64_t len)
+{
+    FileBuffer *chunk = file_data->append;
+
+    // Start a new chunk if the current one is full
+    if (chunk == NULL || chunk->capacity - chunk->size < len)
+    {
+        int64_t capacity = len > APPEND_CHUNK_SIZE ? len : APPEND_CHUNK_SIZE;
+        chunk = (FileBuffer*) malloc(sizeof(FileBuffer) + capacity * sizeof(char));
+
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+
+        chunk->next = file_data->append;
+        chunk->size = 0;
+        chunk->capacity = capacity;
+        file_data->append = chunk;
+    }
+
+    char *slot = chunk->data + chunk->size;
+    chunk->size += len;
+    return slot;
+}
+
+static int read_original(FileData *file_data, FILE *f)
+{
+    int64_t size;
+    int ret = get_file_size(f, &size);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    // Pages of large files are read on access, lines are indexed on request
+    if (size > 0 && size >= file_data->lazy_load_size)
+    {
+        char *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if (mapping != MAP_FAILED)
+        {
+            file_data->original = mapping;
+            file_data->original_size = size;
+            file_data->original_mapped = 1;
+            file_data->unindexed = mapping;
+            return E_SUCCESS;
+        }
+    }
+
+    rewind(f);
+
+    char *buffer = (char*) malloc((size > 0 ? size : 1) * sizeof(char));
+    if (buffer == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    if (fread(buffer, sizeof(char), size, f) != (size_t) size)
+    {
+        free(buffer);
+        return E_IO_ERROR;
+    }
+
+    file_data->original = buffer;
+    file_data->original_size = size;
+    return E_SUCCESS;
+}
+
+static int save_replace(FileData *file_data, const char *file_path, int64_t *written)
+{
+    // The new file is written next to the old one, a rename in the same directory replaces it atomically
+    char *temp_path = (char*) malloc((strlen(file_path) + 8) * sizeof(char));
+    if (temp_path == NULL)
+    {
+        return E_INTERNAL_ERROR;
+    }
+    sprintf(temp_path, "%s.XXXXXX", file_path);
+
+    int fd = mkstemp(temp_path);
+    if (fd < 0)
+    {
+        free(temp_path);
+        return E_IO_ERROR;
+    }
+
+    // Keep the permissions and the owner of the old file, new files get the default ones
+    struct stat target_stat;
+    mode_t mode;
+    int ret = E_SUCCESS;
+    if (stat(file_path, &target_stat) == 0)
+    {
+        mode = target_stat.st_mode & 07777;
+
+        // Files of other users can't be given to them, the new file is then owned by the user
+        if (fchown(fd, target_stat.st_uid, target_stat.st_gid) != 0 && errno != EPERM)
+        {
+            ret = E_IO_ERROR;
+        }
+    }
+    else
+    {
+        mode_t mask = umask(0);
+        umask(mask);
+        mode = 0666 & ~mask;
+    }
+
+    // Unchanged parts of the original file are copied if it is unchanged since it was loaded
+    struct stat original_stat;
+    int copy_fd = -1;
+    if (file_data->original_fd >= 0 && file_data->original_disk.exact && file_data->compression == FILE_DATA_COMPRESSION_NONE &&
+        fstat(file_data->original_fd, &original_stat) == 0 && same_disk_state(&original_stat, &file_data->original_disk))
+    {
+        copy_fd = file_data->original_fd;
+    }
+
+    if (ret == E_SUCCESS)
+    {
+        ret = fchmod(fd, mode) == 0 ? write_file_data(file_data, file_data->start, 0, fd, 0, copy_fd, file_data->compression, written) : E_IO_ERROR;
+    }
+
+    if (ret == E_SUCCESS && file_data->sync_policy != FILE_DATA_SYNC_NONE && fsync(fd) != 0)
+    {
+        ret = E_IO_ERROR;
+    }
+
+    if (ret == E_SUCCESS)
+    {
+        set_disk_state(file_data, fd);
+    }
+
+    if (close(fd) != 0 && ret == E_SUCCESS)
+    {
+        ret = E_IO_ERROR;
+    }
+
+    if (ret == E_SUCCESS && rename(temp_path, file_path) != 0)
+    {
+        ret = E_IO_ERROR;
+    }
+
+    if (ret < 0)
+    {
+        int save_errno = errno;
+        unlink(temp_path);
+        file_data->disk.exact = 0;
+        errno = save_errno;
+    }
+    else if (file_data->sync_policy == FILE_DATA_SYNC_FULL)
+    {
+        ret = sync_parent_dir(file_path);
+    }
+
+    free(temp_path);
+    return ret;
+}
+
+static int find_in_place_start(FileData *file_data, const char *file_path, FileNode **start, int64_t *start_col, int64_t *offset)
+{
+    struct stat file_stat;
+    if (!file_data->disk.exact || stat(file_path, &file_stat) != 0 || !same_disk_state(&file_stat, &file_data->disk))
+    {
+        return 0;
+    }
+
+    // Content before the first modified position is unchanged on disk
+    FileNode *c = file_data->start;
+    int64_t line = 0, head = 0;
+    while (c != NULL && line < file_data->modified_line)
+    {
+        head += c->size + (c->next != NULL || file_data->final_newline);
+        c = c->next;
+        line++;
+    }
+
+    int64_t col = c != NULL ? file_data->modified_col : 0;
+    head += col;
+
+    // Rewriting most of the file in place would give up the atomic replace for little gain
+    char *original_end = file_data->original + file_data->original_size;
+    int64_t tail = 0;
+    for (FileNode *t = c; t != NULL; t = t->next)
+    {
+        // Rewritten content can't be read from the mapping of the file, new lines of empty spans included
+        int64_t skip = t == c ? col : 0;
+        if (file_data->original_mapped && (t != c || skip < t->size) && t->content >= file_data->original && t->content < original_end)
+        {
+            return 0;
+        }
+
+        tail += t->size + (t->next != NULL || file_data->final_newline) - skip;
+        if (tail > head)
+        {
+            return 0;
+        }
+    }
+
+    *start = c;
+    *start_col = col;
+    *offset = head;
+    return 1;
+}
+
+static int save_in_place(FileData *file_data, const char *file_path, FileNode *start, int64_t start_col, int64_t offset, int64_t *written)
+{
+    int fd = open(file_path, O_RDWR);
+    if (fd < 0)
+    {
+        return E_IO_ERROR;
+    }
+
+    // A crash while saving can only leave the rewritten content incomplete
+    file_data->disk.exact = 0;
+    int ret = write_file_data(file_data, start, start_col, fd, offset, -1, FILE_DATA_COMPRESSION_NONE, written);
+
+    if (ret == E_SUCCESS && ftruncate(fd, offset + *written) != 0)
+    {
+        ret = E_IO_ERROR;
+    }
+
+    if (ret == E_SUCCESS && file_data->sync_policy != FILE_DATA_SYNC_NONE && fsync(fd) != 0)
+    {
+        ret = E_IO_ERROR;
+    }
+
+    if (ret == E_SUCCESS)
+    {
+        set_disk_state(file_data, fd);
+    }
+
+    if (close(fd) != 0 && ret == E_SUCCESS)
+    {
+        ret = E_IO_ERROR;
+    }
+
+    return ret;
+}
+
+static void set_disk_state(FileData *file_data, int fd)
+{
+    struct stat file_stat;
+    file_data->modified_line = INT64_MAX;
+    file_data->modified_col = 0;
+    file_data->disk.exact = 0;
+
+    if (fstat(fd, &file_stat) != 0)
+    {
+        return;
+    }
+
+    get_disk_state(&file_stat, &file_data->disk);
+    file_data->disk.exact = file_data->compression == FILE_DATA_COMPRESSION_NONE;
+}
+
+static void set_original_file(FileData *file_data, int fd)
+{
+    struct stat file_stat;
+    file_data->original_fd = dup(fd);
+    file_data->original_disk.exact = 0;
+
+    if (file_data->original_fd >= 0 && fstat(file_data->original_fd, &file_stat) == 0)
+    {
+        get_disk_state(&file_stat, &file_data->original_disk);
+        file_data->original_disk.exact = file_data->compression == FILE_DATA_COMPRESSION_NONE;
+    }
+}
+
+static void get_disk_state(const struct stat *file_stat, FileDataDiskState *state)
+{
+    state->device = file_stat->st_dev;
+    state->inode = file_stat->st_ino;
+    state->size = file_stat->st_size;
+    state->mtime_sec = file_stat->st_mtim.tv_sec;
+    state->mtime_nsec = file_stat->st_mtim.tv_nsec;
+}
+
+static int same_disk_state(const struct stat *file_stat, const FileDataDiskState *state)
+{
+    return file_stat->st_dev == (dev_t) state->device && file_stat->st_ino == (ino_t) state->inode &&
+        file_stat->st_size == state->size && file_stat->st_mtim.tv_sec == state->mtime_sec &&
+        file_stat->st_mtim.tv_nsec == state->mtime_nsec;
+}
+
+static char* line_index_path(const char *file_name)
+{
+    // Sidecar file is ".<name>.lineidx" next to the file
+    const char *name = strrchr(file_name, '/');
+    int dir_len = name != NULL ? name + 1 - file_name : 0;
+    name = name != NULL ? name + 1 : file_name;
+
+    char *path = (char*) malloc((strlen(file_name) + strlen(LINE_INDEX_SUFFIX) + 2) * sizeof(char));
+    if (path != NULL)
+    {
+        sprintf(path, "%.*s.%s%s", dir_len, file_name, name, LINE_INDEX_SUFFIX);
+    }
+
+    return path;
+}
+
+static void open_line_index(FileData *file_data, const char *file_name)
+{
+    FileLineIndex *line_index = (FileLineIndex*) malloc(sizeof(FileLineIndex));
+    if (line_index == NULL)
+    {
+        return;
+    }
+
+    line_index->path = line_index_path(file_name);
+    line_index->data = NULL;
+    line_index->size = 0;
+    line_index->capacity = 0;
+    line_index->pos = 0;
+    line_index->lines = 0;
+    line_index->reading = 0;
+    file_data->line_index = line_index;
+
+    if (line_index->path == NULL || !file_data->original_disk.exact)
+    {
+        free_line_index(file_data);
+        return;
+    }
+
+    // A missing, stale or damaged sidecar file is replaced by a new cache
+    if (read_line_index(file_data, line_index) == E_SUCCESS)
+    {
+        line_index->reading = 1;
+        line_index->pos = 0;
+    }
+    else
+    {
+        free(line_index->data);
+        line_index->data = NULL;
+        line_index->size = 0;
+        line_index->lines = 0;
+    }
+}
+
+static int read_line_index(FileData *file_data, FileLineIndex *line_index)
+{
+    FILE *fin = fopen(line_index->path, "r");
+    if (fin == NULL)
+    {
+        return E_IO_ERROR;
+    }
+
+    LineIndexHeader header;
+    const FileDataDiskState *disk = &file_data->original_disk;
+    if (fread(&header, sizeof(header), 1, fin) != 1 || memcmp(header.magic, LINE_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+        header.file_size != file_data->original_size || header.mtime_sec != disk->mtime_sec ||
+        header.mtime_nsec != disk->mtime_nsec || header.inode != disk->inode || header.lines < 1 ||
+        header.lines > header.file_size + 1 || header.data_size < header.lines || header.data_size > header.lines * 10 ||
+        header.fingerprint != file_fingerprint(file_data))
+    {
+        fclose(fin);
+        return E_IO_ERROR;
+    }
+
+    line_index->data = (unsigned char*) malloc(header.data_size * sizeof(unsigned char));
+    if (line_index->data == NULL || fread(line_index->data, sizeof(unsigned char), header.data_size, fin) != (size_t) header.data_size)
+    {
+        fclose(fin);
+        return E_IO_ERROR;
+    }
+    fclose(fin);
+
+    line_index->size = header.data_size;
+    line_index->lines = header.lines;
+    if (hash_bytes(14695981039346656037ULL, line_index->data, line_index->size) != header.checksum)
+    {
+        return E_IO_ERROR;
+    }
+
+    // Lengths must cover the file exactly, the last line may have no new line
+    int64_t lines = 0, total = 0;
+    line_index->pos = 0;
+    while (line_index->pos < line_index->size)
+    {
+        uint64_t len = 0;
+        int shift = 0;
+        unsigned char byte;
+        do
+        {
+            byte = line_index->data[line_index->pos++];
+            len |= (uint64_t) (byte & 0x7f) << shift;
+            shift += 7;
+        } while ((byte & 0x80) && line_index->pos < line_index->size && shift < 63);
+
+        len >>= 1;
+        if ((byte & 0x80) || len < 1 || len > (uint64_t) file_data->original_size + 1)
+        {
+            return E_IO_ERROR;
+        }
+
+        total += len;
+        lines++;
+    }
+
+    int endl = file_data->original[file_data->original_size - 1] == '\n';
+    return lines == header.lines && total == file_data->original_size + !endl ? E_SUCCESS : E_IO_ERROR;
+}
 
-/**
- * @brief Shift characters in buffer.
- * 
- * The caracter on position start is removed and an empty space is being made on position stop.
- * The other characters are shifted:
- * - to the left, if start < stop 
- * - to the right, if start > stop
- * The removed character is returned
- * 
- * @param buffer character buffer where the shifting occurs (should have at least length max(start, stop) + 1)
- * @param start the start index of the shifting (the character on this position will be removed)
- * @param stop the stop index of the shifting (an empty space will be created on this position)
- * @return char 
- */
-static char shift_chars(char *buffer, int start, int stop);
+static void write_line_index(FileData *file_data)
+{
+    FileLineIndex *line_index = file_data->line_index;
+    struct stat file_stat;
 
-/**
- * @brief Copy buffer to FileLine.
- * 
- * This function updates the inner structure of the FileLine (the size of the line),
- * and ensures proper null string termination.
- * 
- * The length should be less than the line size defined in FileData.
- * 
- * @param line pointer to target FileLine structure
- * @param buffer pointer to source character buffer
- * @param len number of chars to be copied from buffer
- */
-static void write_line(FileLine *line, char *buffer, int len);
+    if (!file_data->original_disk.exact || fstat(file_data->original_fd, &file_stat) != 0 ||
+        !same_disk_state(&file_stat, &file_data->original_disk))
+    {
+        return;
+    }
 
-// /**
-//  * @brief Update the col start of display lines starting from node
-//  * 
-//  * @param start the start node
-//  * @param value the value to be added to col_start
-//  */
-// static void update_col_start(FileNode *start, int value);
-static void update_line(FileNode *start, int value);
+    LineIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LINE_INDEX_MAGIC, sizeof(header.magic));
+    header.file_size = file_data->original_size;
+    header.mtime_sec = file_data->original_disk.mtime_sec;
+    header.mtime_nsec = file_data->original_disk.mtime_nsec;
+    header.inode = file_data->original_disk.inode;
+    header.lines = line_index->lines;
+    header.fingerprint = file_fingerprint(file_data);
+    header.data_size = line_index->size;
+    header.checksum = hash_bytes(14695981039346656037ULL, line_index->data, line_index->size);
+
+    // Written to a temporary file, so a damaged sidecar file is never seen by other instances
+    char *temp_path = (char*) malloc((strlen(line_index->path) + 8) * sizeof(char));
+    if (temp_path == NULL)
+    {
+        return;
+    }
+    sprintf(temp_path, "%s.XXXXXX", line_index->path);
 
-/**
- * @brief Read next valid character from file
- * 
- * @param f file pointer to read from
- */
-static char fget_next_char(FILE *f);
+    int fd = mkstemp(temp_path);
+    if (fd >= 0)
+    {
+        FILE *fout = fdopen(fd, "w");
+        int ok = fout != NULL && fwrite(&header, sizeof(header), 1, fout) == 1 &&
+            fwrite(line_index->data, sizeof(unsigned char), line_index->size, fout) == (size_t) line_index->size;
 
-/**
- * @brief Check if input character is valid for display.
- * 
- * @param c character
- * @return int 0 if false, 1 if true
- */
-static int valid_character(int c);
+        if (fout != NULL)
+        {
+            ok = fclose(fout) == 0 && ok;
+        }
+        else
+        {
+            close(fd);
+        }
 
+        if (!ok || rename(temp_path, line_index->path) != 0)
+        {
+            unlink(temp_path);
+        }
+    }
 
-// ------------------------- Public functions definitions -------------------------
+    free(temp_path);
+}
 
-int create_file_data(int cols, FileData *file_data)
+static void free_line_index(FileData *file_data)
 {
-    if (file_data == NULL || cols < 1)
+    if (file_data->line_index != NULL)
     {
-        return E_INVALID_ARGS;
+        free(file_data->line_index->path);
+        free(file_data->line_index->data);
+        free(file_data->line_index);
+        file_data->line_index = NULL;
     }
+}
 
-    file_data->display_cols = cols;
-    file_data->size = 0;
-    file_data->start = NULL;
-    file_data->end = NULL;
-    file_data->current = NULL;
-    file_data->current_index = -1;
+static int add_line_index_chunk(FileLineIndex *line_index, LoadChunk *chunk)
+{
+    for (FileNode *c = chunk->first; c != NULL; c = c == chunk->last ? NULL : c->next)
+    {
+        // A length takes at most 10 bytes
+        if (line_index->size + 10 > line_index->capacity)
+        {
+            int64_t capacity = line_index->capacity > 0 ? line_index->capacity * 2 : 4096;
+            unsigned char *data = (unsigned char*) realloc(line_index->data, capacity * sizeof(unsigned char));
+            if (data == NULL)
+            {
+                return E_INTERNAL_ERROR;
+            }
+
+            line_index->data = data;
+            line_index->capacity = capacity;
+        }
+
+        uint64_t len = (uint64_t) (c->size + 1) << 1 | (c->tabs == 1);
+        while (len >= 0x80)
+        {
+            line_index->data[line_index->size++] = (len & 0x7f) | 0x80;
+            len >>= 7;
+        }
+        line_index->data[line_index->size++] = len;
+        line_index->lines++;
+    }
 
-    insert_node(file_data, NULL, 0, 0, 1, NULL, 0);
     return E_SUCCESS;
 }
 
-void free_file_data(FileData *file_data)
+static int read_line_index_chunk(FileData *file_data, LoadChunk *chunk)
 {
-    FileNode *node = file_data->start;
-    FileNode *del_node;
+    FileLineIndex *line_index = file_data->line_index;
+    char *end = file_data->original + file_data->original_size;
+    char *line = chunk->start;
 
-    while (node != NULL)
+    // Lengths were validated when the cache was read, the last line may have no new line
+    while (line < end && line - chunk->start < LOAD_CHUNK_SIZE)
     {
-        del_node = node;
-        node = node->next;
-        free_node_data(del_node);
-        free(del_node);
+        uint64_t len = 0;
+        int shift = 0;
+        unsigned char byte;
+        do
+        {
+            byte = line_index->data[line_index->pos++];
+            len |= (uint64_t) (byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        int tabs = len & 1;
+        len >>= 1;
+        if (append_span(chunk, line, len - 1, LINE_ENCODING_UNKNOWN, tabs) == NULL)
+        {
+            return E_INTERNAL_ERROR;
+        }
+
+        line = (int64_t) len <= end - line ? line + len : end;
     }
 
-    file_data->start = NULL;
-    file_data->end = NULL;
-    file_data->current = NULL;
-    file_data->current_index = -1;
-    file_data->size = 0;
+    chunk->size = line - chunk->start;
+    return E_SUCCESS;
 }
 
-int load_file_data(FileData *file_data, const char *file_name)
+static uint64_t file_fingerprint(FileData *file_data)
 {
-    if (file_data == NULL)
+    const unsigned char *content = (const unsigned char*) file_data->original;
+    int64_t size = file_data->original_size;
+    uint64_t hash = hash_bytes(14695981039346656037ULL, (const unsigned char*) &size, sizeof(size));
+
+    // Blocks at the start, at the end and evenly spread in between
+    for (int i = 0; i < LINE_INDEX_SAMPLES; i++)
     {
-        return E_INVALID_ARGS;
+        int64_t start = (size - LINE_INDEX_SAMPLE_SIZE) * i / (LINE_INDEX_SAMPLES - 1);
+        start = start > 0 ? start : 0;
+        int64_t len = size - start < LINE_INDEX_SAMPLE_SIZE ? size - start : LINE_INDEX_SAMPLE_SIZE;
+        hash = hash_bytes(hash, content + start, len);
     }
 
-    free_file_data(file_data);
+    return hash;
+}
 
-    FILE *fin = fopen(file_name, "r");
-    if (fin == NULL)
+static uint64_t hash_bytes(uint64_t hash, const unsigned char *buffer, int64_t size)
+{
+    for (int64_t i = 0; i < size; i++)
     {
-        return E_IO_ERROR;
+        hash = (hash ^ buffer[i]) * 1099511628211ULL;
     }
 
-    char *buffer = (char*) malloc(file_data->display_cols * sizeof(char));
-    if (buffer == NULL)
+    return hash;
+}
+
+static int write_file_data(FileData *file_data, FileNode *start, int64_t start_col, int fd, int64_t offset, int copy_fd,
+    FileDataCompression compression, int64_t *written)
+{
+    static char newline = '\n';
+    SaveBuffer *save = (SaveBuffer*) malloc(sizeof(SaveBuffer));
+    if (save == NULL)
     {
-        fclose(fin);
         return E_INTERNAL_ERROR;
     }
 
-    int buffer_index = 0;
-    int real_line = 0;
-    int col_start = 0;
-    char ch;
-    while ((ch = fget_next_char(fin)) != EOF)
+    save->fd = fd;
+    save->offset = offset;
+    save->copy_fd = copy_fd;
+    save->copy_base = file_data->original;
+    save->copy_size = file_data->original_size;
+    save->count = 0;
+    save->written = 0;
+    save->compress = compression == FILE_DATA_COMPRESSION_GZIP;
+
+    // Window bits above 15 select the gzip format
+    memset(&save->stream, 0, sizeof(save->stream));
+    if (save->compress && deflateInit2(&save->stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
     {
-        // Append character to the buffer
-        if (ch != '\n')
-        {
-            buffer[buffer_index++] = ch;
-        }
+        free(save);
+        return E_INTERNAL_ERROR;
+    }
 
-        // Current display line finished (line full or newline character encountered and non null buffer)
-        if (buffer_index == file_data->display_cols || (ch == '\n' && (buffer_index > 0 || col_start == 0)))
+    int ret = E_SUCCESS;
+    char *original_end = file_data->original + file_data->original_size;
+    FileNode *c = start;
+    while(c != NULL && ret == E_SUCCESS)
+    {
+        // Content of the edited line is split by the gap
+        int64_t before = c == file_data->edit_node ? file_data->gap_start : c->size;
+        int64_t after = c->size - before;
+        char *after_content = c->content + before + (c == file_data->edit_node ? file_data->gap_size : 0);
+
+        // Content of the first line before the start column is not written
+        int64_t skip_before = c == start ? (start_col < before ? start_col : before) : 0;
+        int64_t skip_after = c == start ? start_col - skip_before : 0;
+
+        // Lines of the original buffer are followed by their new line, unless they were shortened
+        char *end = after_content + after;
+        int in_original = c->capacity == 0 && c->content >= file_data->original && end < original_end;
+        char *endl = in_original && *end == '\n' ? end : &newline;
+        int endl_size = c->next != NULL || file_data->final_newline;
+
+        if (save_append(save, c->content + skip_before, before - skip_before) < 0 ||
+            save_append(save, after_content + skip_after, after - skip_after) < 0 ||
+            save_append(save, endl, endl_size) < 0)
         {
-            // Previous display line is no longer the last
-            if (col_start != 0)
-            {
-                file_data->end->data.endl = 0;
-            }
-
-            // Insert node with the new display line
-            FileNode *node = insert_node(file_data, file_data->end, real_line, col_start, 1, buffer, buffer_index);
-
-            if (node == NULL)
-            {
-                free(buffer);
-                fclose(fin);
-                return E_INTERNAL_ERROR;
-            }
-
-            // Reset buffer index and update column start
-            buffer_index = 0;
-            col_start += file_data->display_cols;
+            ret = E_IO_ERROR;
         }
 
-        // If newline character was encountered, reset column start and increment real line count
-        if (ch == '\n')
-        {
-            col_start = 0;
-            real_line++;
-        }
+        c = c->next;
     }
 
-    // Handle any remaining characters in the buffer after EOF
-    if (buffer_index > 0)
+    if (ret == E_SUCCESS)
     {
-        // Previous display line is no longer the last
-        if (col_start != 0)
-        {
-            file_data->end->data.endl = 0;
-        }
-
-        // Insert node with the new display line
-        FileNode *node = insert_node(file_data, file_data->end, real_line, col_start, 1, buffer, buffer_index);
+        ret = save_flush(save);
+    }
 
-        if (node == NULL)
+    if (save->compress)
+    {
+        if (ret == E_SUCCESS)
         {
-            free(buffer);
-            fclose(fin);
-            return E_INTERNAL_ERROR;
+            ret = save_deflate(save, NULL, 0, Z_FINISH);
         }
+        deflateEnd(&save->stream);
     }
 
-    free(buffer);
-    fclose(fin);
-    return E_SUCCESS;
+    *written = save->written;
+    free(save);
+    return ret;
 }
 
-int save_file_data(FileData *file_data, const char* file_path)
+static int save_append(SaveBuffer *save, char *data, int64_t size)
 {
-    if (file_data == NULL || file_path == NULL)
+    if (size == 0)
     {
-        return E_INVALID_ARGS;
+        return E_SUCCESS;
     }
 
-    FILE *fout = fopen(file_path, "w");
-    if (fout == NULL)
+    if (save->count > 0)
+    {
+        struct iovec *last = &save->iov[save->count - 1];
+        if ((char*) last->iov_base + last->iov_len == data)
+        {
+            last->iov_len += size;
+            return E_SUCCESS;
+        }
+    }
+
+    if (save->count == SAVE_IOV_COUNT && save_flush(save) < 0)
     {
         return E_IO_ERROR;
     }
 
-    FileNode *c = file_data->start;
-    while(c != NULL)
+    save->iov[save->count].iov_base = data;
+    save->iov[save->count].iov_len = size;
+    save->count++;
+    return E_SUCCESS;
+}
+
+static int save_flush(SaveBuffer *save)
+{
+    if (save->compress)
     {
-        for (int i = 0; i < c->data.size; i++)
+        for (int i = 0; i < save->count; i++)
         {
-            fputc(c->data.content[i], fout);
+            if (save_deflate(save, (char*) save->iov[i].iov_base, save->iov[i].iov_len, Z_NO_FLUSH) < 0)
+            {
+                return E_IO_ERROR;
+            }
         }
 
-        if (c->data.endl)
+        save->count = 0;
+        return E_SUCCESS;
+    }
+
+    // Large unchanged parts of the original file are copied by the kernel, the rest is written from memory
+    int first = 0;
+    for (int i = 0; i < save->count; i++)
+    {
+        struct iovec *iov = &save->iov[i];
+        char *base = (char*) iov->iov_base;
+
+        if (save->copy_fd >= 0 && iov->iov_len >= SAVE_COPY_MIN_SIZE && base >= save->copy_base &&
+            base + iov->iov_len <= save->copy_base + save->copy_size)
         {
-            fputc('\n', fout);
+            if (save_write(save, save->iov + first, i - first) < 0 || save_copy(save, iov) < 0)
+            {
+                return E_IO_ERROR;
+            }
+            first = i + 1;
         }
+    }
 
-        c = c->next;
+    if (save_write(save, save->iov + first, save->count - first) < 0)
+    {
+        return E_IO_ERROR;
     }
 
-    fclose(fout);
+    save->count = 0;
     return E_SUCCESS;
 }
 
-int resize_file_data_col(FileData *file_data, int cols)
+static int save_write(SaveBuffer *save, struct iovec *iov, int count)
 {
-    if (file_data == NULL || cols < 1)
+    while (count > 0)
     {
-        return E_INVALID_ARGS;
-    }
-
-    FileNode *c = file_data->start;
-    while(c != NULL)
-    {
-        FileLine *data = &(c->data);
-        if (data->size > cols)
+        ssize_t n = pwritev(save->fd, iov, count, save->offset + save->written);
+        if (n < 0)
         {
-            int len = data->size - cols;
-            char *buffer = data->content + cols;
-
-            // Insert new line
-            FileNode *new_node = insert_node(file_data, c, data->line, data->col_start + cols, data->endl, buffer, len);
-            
-            if (new_node == NULL)
+            if (errno == EINTR)
             {
-                return E_INTERNAL_ERROR;
+                continue;
             }
+            return E_IO_ERROR;
+        }
 
-            // Remove moved content from line
-            data->size = cols;
-            data->content[data->size] = '\0';
-            data->endl = 0;
+        // Skip the written parts, a partial write continues in the middle of a part
+        save->written += n;
+        while (count > 0 && (size_t) n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            count--;
         }
 
-        // Resize content buffer
-        char *new_content = realloc(data->content, cols + 1);
-        if (new_content == NULL)
+        if (count > 0)
         {
-            return E_INTERNAL_ERROR;
+            iov->iov_base = (char*) iov->iov_base + n;
+            iov->iov_len -= n;
         }
+    }
 
-        data->content = new_content;
+    return E_SUCCESS;
+}
 
-        c = c->next;
-    }
+static int save_copy(SaveBuffer *save, struct iovec *iov)
+{
+    loff_t src = (char*) iov->iov_base - save->copy_base;
 
-    // Normalize lines
-    file_data->display_cols = cols;
-    FileNode *line_start = file_data->start;
-    while(line_start != NULL)
+    while (iov->iov_len > 0)
     {
-        line_start = normalize_line(file_data, line_start);
+        loff_t dst = save->offset + save->written;
+        ssize_t n = copy_file_range(save->copy_fd, &src, save->fd, &dst, iov->iov_len, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n <= 0)
+        {
+            // Copying is not supported between the files (or the original file is shorter than expected)
+            save->copy_fd = -1;
+            return save_write(save, iov, 1);
+        }
+
+        save->written += n;
+        iov->iov_base = (char*) iov->iov_base + n;
+        iov->iov_len -= n;
     }
 
     return E_SUCCESS;
 }
 
-int set_file_data_line(FileData *file_data, int index)
+static int save_deflate(SaveBuffer *save, char *data, int64_t size, int flush)
 {
-    if (file_data == NULL || index < 0 || index >= file_data->size)
+    z_stream *stream = &save->stream;
+    do
     {
-        return E_INVALID_ARGS;
-    }
-
-    FileNode* new_current = find_node(file_data, index);
+        // Parts larger than the zlib counters are compressed in pieces
+        int64_t len = size < SAVE_DEFLATE_PART ? size : SAVE_DEFLATE_PART;
+        stream->next_in = (Bytef*) data;
+        stream->avail_in = len;
+        data += len;
+        size -= len;
+
+        // Output buffer is written until the input is consumed (and the stream ended, when finishing)
+        do
+        {
+            stream->next_out = save->out;
+            stream->avail_out = SAVE_DEFLATE_SIZE;
+            if (deflate(stream, size > 0 ? Z_NO_FLUSH : flush) == Z_STREAM_ERROR)
+            {
+                return E_INTERNAL_ERROR;
+            }
 
-    if (new_current == NULL)
-    {
-        return E_INTERNAL_ERROR;
-    }
+            struct iovec out = { save->out, SAVE_DEFLATE_SIZE - stream->avail_out };
+            if (out.iov_len > 0 && save_write(save, &out, 1) < 0)
+            {
+                return E_IO_ERROR;
+            }
+        } while (stream->avail_out == 0);
+    } while (size > 0);
 
-    file_data->current = new_current;
-    file_data->current_index = index;
     return E_SUCCESS;
 }
 
-const FileLine* get_file_data_line(FileData *file_data, int index)
+static int sync_parent_dir(const char *file_path)
 {
-    if (file_data == NULL || index < 0 || index >= file_data->size)
+    char *path = strdup(file_path);
+    if (path == NULL)
     {
-        return NULL;
+        return E_INTERNAL_ERROR;
     }
 
-    FileNode *node = find_node(file_data, index);
-
-    if (node == NULL)
+    int fd = open(dirname(path), O_RDONLY | O_DIRECTORY);
+    free(path);
+    if (fd < 0)
     {
-        return NULL;
+        return E_IO_ERROR;
     }
 
-    return &node->data;
+    int ret = fsync(fd) == 0 ? E_SUCCESS : E_IO_ERROR;
+    close(fd);
+    return ret;
 }
 
-int file_data_insert_char(FileData *file_data, int line, int col, char ins)
+static int get_file_size(FILE *f, int64_t *size)
 {
-    if (file_data == NULL || line < 0 || line >= file_data->size || col < 0)
+    if (fseeko(f, 0, SEEK_END) != 0)
     {
-        return E_INVALID_ARGS;
+        return E_IO_ERROR;
     }
 
-    if (!valid_character(ins))
+    off_t end = ftello(f);
+    if (end < 0)
     {
-        return E_INVALID_CHAR;
+        return E_IO_ERROR;
     }
 
-    FileNode *node = find_node(file_data, line);
-    FileLine *data = &(node->data);
+    if ((uint64_t) end > SIZE_MAX)
+    {
+        errno = EFBIG;
+        return E_IO_ERROR;
+    }
 
-    // Edge case for inserting at the end of a source file line
-    int max_col = data->endl ? data->size : data->size - 1;
-    if (col > max_col)
+    *size = end;
+    return E_SUCCESS;
+}
+
+static int start_loader(FileData *file_data, FILE *fin, int64_t size, FileDataCompression compression)
+{
+    rewind(fin);
+    file_data->compression = compression;
+    set_disk_state(file_data, fileno(fin));
+    set_original_file(file_data, fileno(fin));
+
+    FileLoader *loader = (FileLoader*) malloc(sizeof(FileLoader));
+    if (loader == NULL)
     {
-        return E_INVALID_ARGS;
+        fclose(fin);
+        return E_INTERNAL_ERROR;
     }
 
-    if (ins != '\n')
+    loader->file = fin;
+    loader->gz = NULL;
+    loader->size = size;
+    loader->capacity = size;
+    loader->reserved = 0;
+
+    if (compression == FILE_DATA_COMPRESSION_GZIP)
     {
-        int overflow = data->size == file_data->display_cols || col == file_data->display_cols;
-        int start = overflow ? data->size - 1 : data->size + 1;
-    
-        char overflow_char = ins;
-        
-        if (col < file_data->display_cols)
+        // The range is only reserved, pages are made writable by the reader thread as the content grows
+        int64_t reserved = LOAD_GZIP_RESERVE;
+        char *range = MAP_FAILED;
+        while (range == MAP_FAILED && reserved >= LOAD_GZIP_COMMIT)
         {
-            overflow_char = shift_chars(data->content, start, col);
-            data->content[col] = ins;
+            range = mmap(NULL, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            reserved = range == MAP_FAILED ? reserved / 2 : reserved;
         }
 
-        // Overflow character to be moved to next line
-        if (overflow)
+        // The stream may have been rewound within its buffer, the descriptor is positioned explicitly
+        int fd = dup(fileno(fin));
+        loader->gz = fd >= 0 && lseek(fd, 0, SEEK_SET) == 0 ? gzdopen(fd, "rb") : NULL;
+        if (loader->gz == NULL && fd >= 0)
         {
-            // Create new empty display line
-            if (data->endl)
-            {
-                FileNode *new_node = insert_node(file_data, node, data->line, data->col_start + file_data->display_cols, 1, NULL, 0);
+            close(fd);
+        }
 
-                if (new_node == NULL)
-                {
-                    return E_INTERNAL_ERROR;
-                }
+        fclose(fin);
+        loader->file = NULL;
+        loader->buffer = range != MAP_FAILED ? range : NULL;
+        loader->capacity = 0;
+        loader->reserved = reserved;
 
-                // Previous display line is no longer the last
-                node->data.endl = 0;
+        if (loader->buffer == NULL || loader->gz == NULL)
+        {
+            if (loader->gz != NULL)
+            {
+                gzclose(loader->gz);
             }
-
-            // Insert overflow character on the next line
-            if (file_data_insert_char(file_data, line + 1, 0, overflow_char) < 0)
+            if (loader->buffer != NULL)
             {
-                return E_INTERNAL_ERROR;
+                munmap(loader->buffer, reserved);
             }
+            free(loader);
+            return E_INTERNAL_ERROR;
+        }
+    }
+    else
+    {
+        loader->buffer = (char*) malloc((size > 0 ? size : 1) * sizeof(char));
+        if (loader->buffer == NULL)
+        {
+            fclose(fin);
+            free(loader);
+            return E_INTERNAL_ERROR;
+        }
+    }
+
+    loader->bytes_read = 0;
+    loader->input_read = 0;
+    loader->done = 0;
+    loader->cancel = 0;
+    loader->ret = E_SUCCESS;
+    loader->error = 0;
+    loader->indexed = 0;
+    loader->searched = 0;
+    loader->polled = 0;
+    clock_gettime(CLOCK_MONOTONIC, &loader->start_time);
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->progress, NULL);
+
+    // Decompressed content is a mapping, released as a whole
+    file_data->original = loader->buffer;
+    file_data->original_size = loader->gz != NULL ? loader->reserved : size;
+    file_data->original_mapped = loader->gz != NULL;
+
+    if (pthread_create(&loader->thread, NULL, load_reader, loader) != 0)
+    {
+        pthread_cond_destroy(&loader->progress);
+        pthread_mutex_destroy(&loader->lock);
+        if (loader->gz != NULL)
+        {
+            gzclose(loader->gz);
         }
         else
         {
-            data->size++;
+            fclose(loader->file);
+        }
+        free(loader);
+        free_file_data(file_data);
+        return E_INTERNAL_ERROR;
+    }
+
+    file_data->loader = loader;
+    return E_SUCCESS;
+}
+
+static void wait_loader(FileLoader *loader)
+{
+    pthread_mutex_lock(&loader->lock);
+    while (!loader->done && loader->bytes_read == loader->polled)
+    {
+        pthread_cond_wait(&loader->progress, &loader->lock);
+    }
+    pthread_mutex_unlock(&loader->lock);
+}
+
+static void* load_reader(void *arg)
+{
+    FileLoader *loader = (FileLoader*) arg;
+    int64_t bytes_read = 0;
+    int ret = E_SUCCESS;
+    int error = 0;
+
+    while (1)
+    {
+        pthread_mutex_lock(&loader->lock);
+        int cancel = loader->cancel;
+        pthread_mutex_unlock(&loader->lock);
+
+        if (cancel)
+        {
+            break;
+        }
+
+        int64_t count = load_read_block(loader, bytes_read);
+        if (count <= 0)
+        {
+            ret = count < 0 ? (int) count : E_SUCCESS;
+            error = count < 0 ? errno : 0;
+            break;
         }
+
+        bytes_read += count;
+        int64_t input_read = loader->gz != NULL ? gzoffset(loader->gz) : bytes_read;
+        pthread_mutex_lock(&loader->lock);
+        loader->bytes_read = bytes_read;
+        loader->input_read = input_read;
+        pthread_cond_broadcast(&loader->progress);
+        pthread_mutex_unlock(&loader->lock);
+    }
+
+    if (loader->gz != NULL)
+    {
+        gzclose(loader->gz);
     }
     else
     {
-        // Pointer to data to be copied
-        int len = data->size - col;
-        char *buffer = data->content + col;
+        fclose(loader->file);
+    }
 
-        // Insert new line
-        FileNode *new_node = insert_node(file_data, node, data->line + 1, 0, data->endl, buffer, len);
-        if (new_node == NULL)
+    pthread_mutex_lock(&loader->lock);
+    loader->ret = ret;
+    loader->error = error;
+    loader->done = 1;
+    pthread_cond_broadcast(&loader->progress);
+    pthread_mutex_unlock(&loader->lock);
+    return NULL;
+}
+
+static int64_t load_read_block(FileLoader *loader, int64_t offset)
+{
+    if (loader->gz == NULL)
+    {
+        int64_t len = loader->size - offset < LOAD_READ_BLOCK ? loader->size - offset : LOAD_READ_BLOCK;
+        size_t count = len > 0 ? fread(loader->buffer + offset, sizeof(char), len, loader->file) : 0;
+
+        // File truncated while loading ends the file early
+        return count == 0 && ferror(loader->file) ? E_IO_ERROR : (int64_t) count;
+    }
+
+    // Pages of the reserved range are made writable ahead of the decompressed content
+    if (offset + LOAD_READ_BLOCK > loader->capacity)
+    {
+        if (loader->capacity + LOAD_GZIP_COMMIT > loader->reserved)
         {
+            errno = EFBIG;
             return E_INTERNAL_ERROR;
         }
 
-        // Shift subsequent lines
-        update_line(new_node->next, 1);
+        if (mprotect(loader->buffer + loader->capacity, LOAD_GZIP_COMMIT, PROT_READ | PROT_WRITE) != 0)
+        {
+            return E_INTERNAL_ERROR;
+        }
+        loader->capacity += LOAD_GZIP_COMMIT;
+    }
 
-        // Remove moved content from line
-        data->size = col;
-        data->content[data->size] = '\0';
-        data->endl = 1;
+    int count = gzread(loader->gz, loader->buffer + offset, LOAD_READ_BLOCK);
 
-        // Shift content of subsequent lines
-        (void) normalize_line(file_data, new_node);
+    // Corrupted and truncated streams fail the load, errors of the file keep their errno
+    int status;
+    gzerror(loader->gz, &status);
+    if (count < 0 || (count == 0 && status != Z_OK))
+    {
+        errno = status == Z_ERRNO ? errno : EBADMSG;
+        return E_IO_ERROR;
     }
 
-    return E_SUCCESS;
+    return count;
 }
 
-int file_data_delete_char(FileData *file_data, int line, int col)
+static int gzip_file(FILE *f)
 {
-    FileNode *node = find_node(file_data, line);
+    unsigned char magic[2];
+    int gzip = fread(magic, sizeof(unsigned char), 2, f) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    rewind(f);
+    return gzip;
+}
 
-    if (node == NULL || col >= node->data.size || col < -1)
+static void stop_loader(FileData *file_data)
+{
+    FileLoader *loader = file_data->loader;
+    if (loader == NULL)
     {
-        return E_INVALID_ARGS;
+        return;
     }
 
-    if (col == -1)
+    pthread_mutex_lock(&loader->lock);
+    loader->cancel = 1;
+    pthread_mutex_unlock(&loader->lock);
+
+    pthread_join(loader->thread, NULL);
+    pthread_cond_destroy(&loader->progress);
+    pthread_mutex_destroy(&loader->lock);
+    free(loader);
+    file_data->loader = NULL;
+}
+
+static int index_lazy(FileData *file_data, int64_t rows, int64_t lines)
+{
+    while (file_data->unindexed != NULL && (file_data->size <= rows || file_data->lines <= lines))
     {
-        if (node->prev != NULL)
+        char *end = file_data->original + file_data->original_size;
+
+        LoadChunk chunk;
+        chunk.start = file_data->unindexed;
+        chunk.size = end - chunk.start;
+        chunk.first = NULL;
+        chunk.last = NULL;
+        chunk.node_chunks = NULL;
+        chunk.seed = next_priority(file_data);
+        chunk.ret = E_SUCCESS;
+
+        FileLineIndex *line_index = file_data->line_index;
+        if (line_index != NULL && line_index->reading)
+        {
+            chunk.ret = read_line_index_chunk(file_data, &chunk);
+        }
+        else
         {
-            if (node->prev->data.endl)
+            // Chunk ends after a new line, so lines are not split
+            if (chunk.size > LOAD_CHUNK_SIZE)
             {
-                // Merge with previous line if it exits
-                update_line(node, -1);
-                node->prev->data.endl = 0;
-                (void) normalize_line(file_data, node->prev);
-                return E_SUCCESS;
+                char *new_line = memchr(chunk.start + LOAD_CHUNK_SIZE - 1, '\n', chunk.size - LOAD_CHUNK_SIZE + 1);
+                chunk.size = new_line != NULL ? new_line + 1 - chunk.start : chunk.size;
             }
-            else
+
+            chunk.ret = scan_chunk(&chunk, select_scan_block());
+
+            if (line_index != NULL && (chunk.ret < 0 || add_line_index_chunk(line_index, &chunk) < 0))
             {
-                // Delete last chracter on previous line
-                return file_data_delete_char(file_data, line - 1, node->prev->data.size - 1);
+                free_line_index(file_data);
             }
         }
 
-        return E_INVALID_CHAR;
-    }
+        merge_chunk(file_data, &chunk);
+        if (chunk.ret < 0)
+        {
+            return chunk.ret;
+        }
 
-    // Delete character on line
-    (void) shift_chars(node->data.content, col, node->data.size);
-    
-    // Shift characters around display lines
-    if (node->next != NULL && node->data.line == node->next->data.line)
-    {
-        node->data.content[node->data.size - 1] = node->next->data.content[0];
-        return file_data_delete_char(file_data, line + 1, 0);
-    }
-    else
-    {
-        node->data.size--;
-        node->data.content[node->data.size] = '\0';
+        file_data->unindexed = chunk.start + chunk.size < end ? chunk.start + chunk.size : NULL;
+        tree_append(file_data, chunk.first);
+        update_counters(file_data);
 
-        if (node->data.size == 0 && node->data.col_start != 0)
+        // Cache is complete once the whole file is indexed
+        if (file_data->unindexed == NULL && file_data->line_index != NULL)
         {
-            delete_node(file_data, node);
+            if (!file_data->line_index->reading)
+            {
+                write_line_index(file_data);
+            }
+            free_line_index(file_data);
         }
     }
 
     return E_SUCCESS;
 }
 
-void file_data_check_integrity(FileData *file_data)
+static int index_lines(FileData *file_data, char *buffer, int64_t size)
 {
-    // FileData assertions
-    assert((file_data->current_index >= 0 && file_data->current_index < file_data->size) || (file_data->current_index == -1 && file_data->current == NULL)); // Current node should be part of internal structure
-    assert(file_data->size >= 0); // Positive size
-    assert(file_data->display_cols > 0); // Positive non 0 number of display columns
-
-    // Node iteration
-    int count = 0;
-    FileNode *c = file_data->start;
-    FileNode *prev = NULL;
+    LoadState state;
+    state.count = (size + LOAD_CHUNK_SIZE - 1) / LOAD_CHUNK_SIZE;
+    state.next = 0;
+    state.scan_block = select_scan_block();
+    state.chunks = (LoadChunk*) malloc((state.count > 0 ? state.count : 1) * sizeof(LoadChunk));
 
-    while(c != NULL)
+    if (state.chunks == NULL)
     {
-        // Linked list assertions
-        assert((c == file_data->start && c->prev == NULL) || c->prev != NULL); // Prev navigation if not first node
-        assert((c == file_data->end && c->next == NULL) || c->next != NULL); // Next navigation if not last node
-        assert(c->prev == prev); // Check backward navigation
-        assert((c == file_data->current && count == file_data->current_index) || count != file_data->current_index); // Current node index should correspond with position in structure and no other
+        return E_INTERNAL_ERROR;
+    }
 
-        // FileLine assertions
-        FileLine *data = &c->data;
+    // Chunks end after a new line, so lines are not split
+    char *chunk_start = buffer;
+    for (int i = 0; i < state.count; i++)
+    {
+        LoadChunk *chunk = &state.chunks[i];
+        char *chunk_end = buffer + size;
 
-        // - line integrity
-        if (c->prev != NULL)
+        if (i < state.count - 1 && chunk_start < buffer + (int64_t) (i + 1) * LOAD_CHUNK_SIZE)
         {
-            FileLine *lastData = &c->prev->data;
-            if (data->line == lastData->line)
-            {
-                assert(lastData->size == file_data->display_cols); // Current display line should continue only a completed previous display line if on the same source file line
-                assert(data->col_start == lastData->col_start + file_data->display_cols); // Col start should keep consistency
-            }
-            else
-            {
-                assert(data->line == lastData->line + 1); // No jumps in source file line number
-                assert(data->col_start == 0); // First display line in source file line starts at character 0
-            }
+            char *split = buffer + (int64_t) (i + 1) * LOAD_CHUNK_SIZE - 1;
+            char *new_line = memchr(split, '\n', buffer + size - split);
+            chunk_end = new_line != NULL ? new_line + 1 : buffer + size;
         }
-
-        assert(data->endl == (c->next == NULL || c->next->data.line != data->line)); // Check end of line marked correctly
-    
-        // - content integrity
-        assert(data->size <= file_data->display_cols && data->size >= 0); // Display line size should not exceed configuration in file_data
-        assert((data->size == 0 && data->col_start == 0) || data->size != 0); // Only the beginning of the line can be empty
-        assert(data->content[data->size] == '\0'); // Display line content should be null terminated at size
-
-        for (int i = 0; i < data->size; i++)
+        else if (i < state.count - 1)
         {
-            assert(data->content[i] != '\0'); // No null characters inside display line content
+            chunk_end = chunk_start;
         }
 
-        // Next iteration
-        prev = c;
-        c = c->next;
-        count++;
+        chunk->start = chunk_start;
+        chunk->size = chunk_end - chunk_start;
+        chunk->first = NULL;
+        chunk->last = NULL;
+        chunk->node_chunks = NULL;
+        chunk->seed = next_priority(file_data);
+        chunk->done = 0;
+        chunk->ret = E_SUCCESS;
+        chunk_start = chunk_end;
     }
 
-    assert(count == file_data->size); // Number of display lines should correspond with iterated nodes
-    assert(file_data->end == prev); // Last visited node should be the end one
-}
-
-int file_data_get_display_coords(FileData *file_data, int source_line, int source_col, int *display_line, int *display_col)
-{
-    if (file_data == NULL || display_line == NULL || display_col == NULL)
-    {
-        return E_INVALID_ARGS;
-    }
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.chunk_done, NULL);
 
-    FileNode* node = file_data->current != NULL ? file_data->current : file_data->start;
-    int current_index = file_data->current != NULL ? file_data->current_index : 0;
+    // The calling thread also indexes chunks, in order, while waiting for the workers
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cpus > 1 ? cpus - 1 : 0;
+    workers = workers < state.count - 1 ? workers : state.count - 1;
+    workers = workers < LOAD_MAX_THREADS ? workers : LOAD_MAX_THREADS;
 
-    if (node == NULL)
+    pthread_t threads[LOAD_MAX_THREADS];
+    int started = 0;
+    while (started < workers && pthread_create(&threads[started], NULL, load_worker, &state) == 0)
     {
-        return E_INVALID_ARGS;
+        started++;
     }
 
-    // Set iteration direction
-    int dir = 1;
-    if (source_line < node->data.line || (source_line == node->data.line && source_col < node->data.col_start && source_col != -1))
+    int ret = E_SUCCESS;
+    FileNode *tree_end = file_data->end;
+    for (int i = 0; i < state.count; i++)
     {
-        dir = -1;
-    }
+        LoadChunk *chunk = &state.chunks[i];
 
-    int i = current_index;
-    while (node != NULL)
-    {
-        if (source_line == node->data.line)
+        pthread_mutex_lock(&state.lock);
+        while (!chunk->done)
         {
-            int col_min = node->data.col_start;
-            if (node->data.col_start == 0)
+            if (state.next < state.count)
             {
-                col_min--;
+                pthread_mutex_unlock(&state.lock);
+                load_next_chunk(&state);
+                pthread_mutex_lock(&state.lock);
             }
-
-            int col_min_ok = source_col > col_min;
-            int col_max_ok = source_col <= node->data.col_start + node->data.size;
-
-            // source column greater than source line length
-            if (!col_max_ok && node->data.endl)
+            else
             {
-                source_col = -1;
+                pthread_cond_wait(&state.chunk_done, &state.lock);
             }
+        }
+        pthread_mutex_unlock(&state.lock);
 
-            int col_end_ok = source_col == -1 && node->data.endl;
-
-            // Found the display line
-            if ((col_min_ok && col_max_ok) || col_end_ok)
-            {
-                *display_line = i;
-                *display_col = (source_col == -1) ? node->data.size : source_col - node->data.col_start;
-                return E_SUCCESS;
-            }
+        if (chunk->ret < 0)
+        {
+            ret = chunk->ret;
         }
 
-        // Go to the next node
-        i += dir;
-        node = (dir == 1) ? node->next : node->prev;
+        merge_chunk(file_data, chunk);
     }
 
-    return E_INVALID_ARGS;
-}
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
 
+    pthread_cond_destroy(&state.chunk_done);
+    pthread_mutex_destroy(&state.lock);
+    free(state.chunks);
 
-// ------------------------- Private functions definitions -------------------------
+    // Nodes of the merged chunks are added to the tree at once
+    tree_append(file_data, tree_end != NULL ? tree_end->next : file_data->start);
+    update_counters(file_data);
+    return ret;
+}
 
-static FileNode* insert_node(FileData *file_data, FileNode *node, int line, int col_start, int endl, char *content_buffer, int len)
+static void* load_worker(void *arg)
 {
-    if (file_data == NULL || (content_buffer == NULL && len != 0))
+    LoadState *state = (LoadState*) arg;
+
+    while (load_next_chunk(state))
     {
-        return NULL;
     }
 
-    // Allocate memory for node
-    FileNode *new_node = (FileNode*) malloc(sizeof(FileNode));
+    return NULL;
+}
 
-    if (new_node == NULL)
+static int load_next_chunk(LoadState *state)
+{
+    pthread_mutex_lock(&state->lock);
+    if (state->next == state->count)
     {
-        return NULL;
+        pthread_mutex_unlock(&state->lock);
+        return 0;
     }
 
-    new_node->data.content = (char*) malloc((file_data->display_cols + 1) * sizeof(char));
+    LoadChunk *chunk = &state->chunks[state->next++];
+    pthread_mutex_unlock(&state->lock);
 
-    if (new_node->data.content == NULL)
-    {
-        free(new_node);
-        return NULL;
-    }
+    int ret = scan_chunk(chunk, state->scan_block);
 
-    // Initialize node data
-    new_node->data.line = line;
-    new_node->data.col_start = col_start;
-    new_node->data.endl = endl;
+    pthread_mutex_lock(&state->lock);
+    chunk->ret = ret;
+    chunk->done = 1;
+    pthread_cond_broadcast(&state->chunk_done);
+    pthread_mutex_unlock(&state->lock);
+    return 1;
+}
 
-    // Copy data from buffer into new line
-    write_line(&new_node->data, content_buffer, len);
+static int scan_chunk(LoadChunk *chunk, uint64_t (*scan)(const char *block, uint64_t *high, uint64_t *tabs))
+{
+    char *buffer = chunk->start;
+    int64_t size = chunk->size;
+    char *line_start = buffer;
 
-    // Update linked list structure
-    new_node->next = node != NULL ? node->next : NULL;
-    new_node->prev = node;
+    // End of the last byte above 127 and of the last tab, lines starting after them are ASCII or have no tabs
+    char *high_end = buffer;
+    char *tab_end = buffer;
 
-    // If the node to be inserted is not the last one
-    if (node != NULL && node->next != NULL)
-    {
-        node->next->prev = new_node;
-    }
-    else
+    for (int64_t block = 0; block < size; block += SCAN_BLOCK_SIZE)
     {
-        file_data->end = new_node;
-    }
+        uint64_t mask, high, tabs;
+        if (size - block >= SCAN_BLOCK_SIZE)
+        {
+            mask = scan(buffer + block, &high, &tabs);
+        }
+        else
+        {
+            mask = scan_block_scalar(buffer + block, size - block, &high, &tabs);
+        }
 
-    // If the node to be inserted is not the first one
-    if (node != NULL)
-    {
-        node->next = new_node;
-    }
-    else
-    {
-        file_data->start = new_node;
-    }
+        // New lines in order
+        while (mask != 0)
+        {
+            int bit = __builtin_ctzll(mask);
+            char *line_end = buffer + block + bit;
+            mask &= mask - 1;
 
-    // Update file data size
-    file_data->size++;
+            uint64_t before = high & ((1ULL << bit) - 1);
+            if (before != 0)
+            {
+                high_end = buffer + block + SCAN_BLOCK_SIZE - __builtin_clzll(before);
+            }
 
-    return new_node;
-}
+            before = tabs & ((1ULL << bit) - 1);
+            if (before != 0)
+            {
+                tab_end = buffer + block + SCAN_BLOCK_SIZE - __builtin_clzll(before);
+            }
 
-static void delete_node(FileData *file_data, FileNode *node)
-{
-    if (node == NULL || file_data == NULL)
-    {
-        return;
-    }
+            int64_t len = line_end - line_start;
+            int encoding = high_end <= line_start ? FILE_LINE_ASCII : (int) text_encoding(line_start, len);
+            if (append_span(chunk, line_start, len, encoding, tab_end > line_start) == NULL)
+            {
+                return E_INTERNAL_ERROR;
+            }
+            line_start = line_end + 1;
+        }
 
-    // If the node to be deleted is the start node
-    if (node->prev == NULL)
-    {
-        file_data->start = node->next;
-        if (file_data->start != NULL)
+        if (high != 0)
         {
-            file_data->start->prev = NULL;
+            high_end = buffer + block + SCAN_BLOCK_SIZE - __builtin_clzll(high);
         }
-    }
-    else
-    {
-        node->prev->next = node->next;
-    }
 
-    // If the node to be deleted is the last node
-    if (node->next == NULL)
-    {
-        file_data->end = node->prev;
-        if (file_data->end != NULL)
+        if (tabs != 0)
         {
-            file_data->end->next = NULL;
+            tab_end = buffer + block + SCAN_BLOCK_SIZE - __builtin_clzll(tabs);
         }
     }
-    else
-    {
-        node->next->prev = node->prev;
-    }
 
-    // Update the current pointer if it points to the node being deleted
-    if (file_data->current == node)
+    // Last line without new line
+    if (line_start < buffer + size)
     {
-        file_data->current = node->next != NULL ? node->next : node->prev;
-        
-        if (node->next == NULL)
+        int64_t len = buffer + size - line_start;
+        int encoding = high_end <= line_start ? FILE_LINE_ASCII : (int) text_encoding(line_start, len);
+        if (append_span(chunk, line_start, len, encoding, tab_end > line_start) == NULL)
         {
-            file_data->current_index--;
+            return E_INTERNAL_ERROR;
         }
     }
-    
-    // Update line flags for previous node
-    if (node->data.endl && node->prev != NULL && node->prev->data.line == node->data.line)
-    {
-        node->prev->data.endl = 1;
-    }
 
-    // Update file data size
-    file_data->size--;
-
-    // Free deleted node
-    free_node_data(node);
-    free(node);
+    return E_SUCCESS;
 }
 
-static FileNode* find_node(const FileData *file_data, int index)
+static FileNode* append_span(LoadChunk *chunk, char *span, int64_t len, int encoding, int tabs)
 {
-    // Ensure the index is within bounds
-    if (file_data == NULL || index < 0 || index >= file_data->size)
+    FileNode *new_node = alloc_pool_node(&chunk->node_chunks);
+
+    if (new_node == NULL)
     {
         return NULL;
     }
 
-    FileNode* node = file_data->current != NULL ? file_data->current : file_data->start;
-    int current_index = file_data->current != NULL ? file_data->current_index : 0;
-
-    // Find the index by going forwards or backwards in the list starting with current node
-    if (index > current_index)
+    new_node->content = span;
+    new_node->size = len;
+    new_node->capacity = 0;
+    new_node->priority = next_random(&chunk->seed);
+    new_node->encoding = encoding;
+    new_node->tabs = tabs;
+    new_node->weight = 0;
+
+    new_node->next = NULL;
+    new_node->prev = chunk->last;
+    if (chunk->last != NULL)
     {
-        for (int i = current_index; i < index && node != NULL; i++)
-        {
-            node = node->next;
-        }
+        chunk->last->next = new_node;
     }
-    else if (index < current_index)
+    else
     {
-        for (int i = current_index; i > index && node != NULL; i--)
-        {
-            node = node->prev;
-        }
+        chunk->first = new_node;
     }
+    chunk->last = new_node;
 
-    // // Check if the node is found
-    // if (node != NULL)
-    // {
-    //     // Update the current index and pointer
-    //     file_data->current = node;
-    //     file_data->current_index = index;
-    // }
-
-    return node;
+    return new_node;
 }
 
-static FileNode* normalize_line(FileData *file_data, FileNode *node)
+static void merge_chunk(FileData *file_data, LoadChunk *chunk)
 {
-    // Stop conditions
-    if (node == NULL)
+    // Node pool of the chunk is owned by the structure, even if the chunk failed
+    if (chunk->node_chunks != NULL)
     {
-        return node;
-    }
-    else if (node->data.endl)
-    {
-        return node->next;
-    }
+        FileNodeChunk *last_chunk = chunk->node_chunks;
+        while (last_chunk->next != NULL)
+        {
+            last_chunk = last_chunk->next;
+        }
 
-    FileLine *line = &node->data;
-    FileLine *nextLine = &node->next->data;
+        last_chunk->next = file_data->node_chunks;
+        file_data->node_chunks = chunk->node_chunks;
+    }
 
-    if (nextLine->size == 0)
+    if (chunk->ret < 0 || chunk->first == NULL)
     {
-        // Inherit the end of line flag from deleted node
-        line->endl = nextLine->endl;
-
-        // Next line has been emptied and can be removed
-        delete_node(file_data, node->next);
-
-        // Retry with next line
-        return normalize_line(file_data, node);
+        return;
     }
 
-    if (node->data.size == file_data->display_cols)
+    chunk->first->prev = file_data->end;
+    if (file_data->end != NULL)
     {
-        nextLine->col_start = line->col_start + file_data->display_cols;
-        return normalize_line(file_data, node->next);
+        file_data->end->next = chunk->first;
     }
-
-    int move_len = file_data->display_cols - line->size;
-    if (move_len > nextLine->size)
+    else
     {
-        // Next line is shorter than the needed number of characters
-        move_len = nextLine->size;
+        file_data->start = chunk->first;
     }
+    file_data->end = chunk->last;
+}
 
-    // Move characters from next line into current line
-    memcpy(line->content + line->size, nextLine->content, move_len * sizeof(char));
-    line->size += move_len;
-    line->content[line->size] = '\0';
+static uint64_t (*select_scan_block(void))(const char *block, uint64_t *high, uint64_t *tabs)
+{
+#ifdef SCAN_SIMD
+    return __builtin_cpu_supports("avx2") ? scan_block_avx2 : scan_block_sse2;
+#else
+    return scan_full_block_scalar;
+#endif
+}
 
-    // Shift remaining characters on the next line and update length
-    int left_len = nextLine->size - move_len;
+#ifndef SCAN_SIMD
+static uint64_t scan_full_block_scalar(const char *block, uint64_t *high, uint64_t *tabs)
+{
+    return scan_block_scalar(block, SCAN_BLOCK_SIZE, high, tabs);
+}
+#endif
 
-    if (left_len > 0)
+static uint64_t scan_block_scalar(const char *block, int len, uint64_t *high, uint64_t *tabs)
+{
+    uint64_t mask = 0;
+    *high = 0;
+    *tabs = 0;
+    for (int i = 0; i < len; i++)
     {
-        memmove(nextLine->content, nextLine->content + move_len, left_len * sizeof(char));
+        mask |= (uint64_t) (block[i] == '\n') << i;
+        *high |= (uint64_t) ((unsigned char) block[i] >= 0x80) << i;
+        *tabs |= (uint64_t) (block[i] == '\t') << i;
     }
 
-    nextLine->content[left_len] = '\0';
-    nextLine->col_start = line->col_start + file_data->display_cols;
-    nextLine->size = left_len;
+    return mask;
+}
 
+#ifdef SCAN_SIMD
+static uint64_t scan_block_sse2(const char *block, uint64_t *high, uint64_t *tabs)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i tab = _mm_set1_epi8('\t');
+    uint64_t mask = 0;
+    *high = 0;
+    *tabs = 0;
 
-    // Go to the next node if current line completely filled and no deletion pending
-    FileNode *nextNode = node;
-    if (line->size == file_data->display_cols && left_len != 0)
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i += 16)
     {
-        nextNode = node->next;
+        __m128i x = _mm_loadu_si128((const __m128i*) (block + i));
+        mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(x, newline)) << i;
+        *high |= (uint64_t) (uint16_t) _mm_movemask_epi8(x) << i;
+        *tabs |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(x, tab)) << i;
     }
-    return normalize_line(file_data, nextNode);
-}
 
-static void free_node_data(FileNode *node)
-{
-    free(node->data.content);
-    node->data.content = NULL;
-    node->data.size = 0;
-    node->data.line = 0;
-    node->data.col_start = 0;
+    return mask;
 }
 
-static char shift_chars(char *buffer, int start, int stop)
+__attribute__((target("avx2")))
+static uint64_t scan_block_avx2(const char *block, uint64_t *high, uint64_t *tabs)
 {
-    char overflow = buffer[start];
-    int dir = start < stop ? 1 : -1;
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    uint64_t mask = 0;
+    *high = 0;
+    *tabs = 0;
 
-    for (int i = start; dir * i < dir * stop; i += dir) 
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i += 32)
     {
-        buffer[i] = buffer[i + dir];
+        __m256i x = _mm256_loadu_si256((const __m256i*) (block + i));
+        mask |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, newline)) << i;
+        *high |= (uint64_t) (uint32_t) _mm256_movemask_epi8(x) << i;
+        *tabs |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, tab)) << i;
     }
 
-    buffer[stop] = '\0';
-    return overflow;
+    return mask;
 }
+#endif
 
-static void write_line(FileLine *line, char *buffer, int len)
+static FileLineEncoding line_encoding(FileData *file_data, FileNode *node)
 {
-    if (line == NULL || (buffer == NULL && len != 0) || len < 0)
+    if (node->encoding != LINE_ENCODING_UNKNOWN)
     {
-        return;
+        return (FileLineEncoding) node->encoding;
     }
 
-    if (len > 0)
+    // Edited line is checked around the gap, it is closed only if multibyte characters may cross it
+    if (node == file_data->edit_node && file_data->gap_size > 0)
     {
-        strncpy(line->content, buffer, len);
+        int64_t after = file_data->gap_start + file_data->gap_size;
+        if (text_encoding(node->content, file_data->gap_start) == FILE_LINE_ASCII &&
+            text_encoding(node->content + after, node->size - file_data->gap_start) == FILE_LINE_ASCII)
+        {
+            node->encoding = FILE_LINE_ASCII;
+            return FILE_LINE_ASCII;
+        }
+
+        close_gap(file_data);
     }
 
-    line->content[len] = '\0';
-    line->size = len;
+    node->encoding = text_encoding(node->content, node->size);
+    return (FileLineEncoding) node->encoding;
 }
 
-// static void update_col_start(FileNode *start, int value)
-// {
-//     FileNode *c = start;
+static FileLineEncoding text_encoding(const char *text, int64_t size)
+{
+    int64_t i = 0;
+
+    // ASCII prefix is skipped a word at a time
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, text + i, sizeof(word));
+        if ((word & 0x8080808080808080ULL) != 0)
+        {
+            break;
+        }
+    }
 
-//     while (c != NULL && start->data.line == c->data.line)
-//     {
-//         c->data.col_start += value;
-//         c = c->next;
-//     }
-// }
+    while (i < size && (unsigned char) text[i] < 0x80)
+    {
+        i++;
+    }
 
-static void update_line(FileNode *start, int value)
-{
-    FileNode *c = start;
+    if (i == size)
+    {
+        return FILE_LINE_ASCII;
+    }
+
+    return valid_utf8(text + i, size - i) ? FILE_LINE_UTF8 : FILE_LINE_BINARY;
+}
 
-    while (c != NULL)
+static int valid_utf8(const char *text, int64_t size)
+{
+#ifdef SCAN_SIMD
+    if (size >= 32 && __builtin_cpu_supports("avx2"))
     {
-        c->data.line += value;
-        c = c->next;
+        return valid_utf8_avx2(text, size);
     }
+#endif
+
+    return valid_utf8_scalar((const unsigned char*) text, size);
 }
 
-static char fget_next_char(FILE *f)
+static int valid_utf8_scalar(const unsigned char *text, int64_t size)
 {
-    while(1)
+    int64_t i = 0;
+    while (i < size)
     {
-        char ch = fgetc(f);
-        if (ch == EOF)
+        unsigned char c = text[i];
+        if (c < 0x80)
         {
-            return EOF;
+            i++;
+            continue;
         }
 
-        if (valid_character(ch))
+        // Sequence length and smallest code point for that length
+        int len;
+        uint32_t cp, min;
+        if (c >= 0xC2 && c <= 0xDF)
         {
-            return ch;
+            len = 2;
+            cp = c & 0x1F;
+            min = 0x80;
         }
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            len = 3;
+            cp = c & 0x0F;
+            min = 0x800;
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            len = 4;
+            cp = c & 0x07;
+            min = 0x10000;
+        }
+        else
+        {
+            return 0;
+        }
+
+        if (size - i < len)
+        {
+            return 0;
+        }
+
+        for (int k = 1; k < len; k++)
+        {
+            if ((text[i + k] & 0xC0) != 0x80)
+            {
+                return 0;
+            }
+            cp = (cp << 6) | (text[i + k] & 0x3F);
+        }
+
+        if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        {
+            return 0;
+        }
+        i += len;
     }
+
+    return 1;
 }
 
-static int valid_character(int c)
+#ifdef SCAN_SIMD
+__attribute__((target("avx2")))
+static int valid_utf8_avx2(const char *text, int64_t size)
 {
-    if (c == EOF || c == '\n' || c == '\t')
+    // Last bytes of a block which must not start an unfinished sequence
+    const __m256i max_last = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char) 0xEF, (char) 0xDF, (char) 0xBF);
+    __m256i prev = _mm256_setzero_si256();
+    __m256i error = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+
+    int64_t i = 0;
+    for (; i + 32 <= size; i += 32)
     {
-        return 1;
+        __m256i input = _mm256_loadu_si256((const __m256i*) (text + i));
+        if (_mm256_movemask_epi8(input) == 0)
+        {
+            // ASCII block, only a sequence left open by the previous block is an error
+            error = _mm256_or_si256(error, incomplete);
+        }
+        else
+        {
+            error = _mm256_or_si256(error, utf8_block_errors(input, prev));
+            incomplete = _mm256_subs_epu8(input, max_last);
+        }
+        prev = input;
+    }
+
+    // Last partial block is padded with zeros
+    if (i < size)
+    {
+        char last[32] = {0};
+        memcpy(last, text + i, size - i);
+        __m256i input = _mm256_loadu_si256((const __m256i*) last);
+        error = _mm256_or_si256(error, utf8_block_errors(input, prev));
+        incomplete = _mm256_setzero_si256();
     }
 
-    return c >= 32 && c < 128;
+    error = _mm256_or_si256(error, incomplete);
+    return _mm256_testz_si256(error, error);
 }
+
+__attribute__((target("avx2")))
+static __m256i utf8_block_errors(__m256i input, __m256i prev)
+{
+    // Error classes of a byte pair, combined by the lookups below
+    const char TOO_SHORT = 1 << 0;
+    const char TOO_LONG = 1 << 1;
+    const char OVERLONG_3 = 1 << 2;
+    const char TOO_LARGE = 1 << 3;
+    const char SURROGATE = 1 << 4;
+    const char OVERLONG_2 = 1 << 5;
+    const char TOO_LARGE_1000 = 1 << 6;
+    const char OVERLONG_4 = 1 << 6;
+    const char TWO_CONTS = (char) (1 << 7);
+    const char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    const __m256i byte_1_high_table = _mm256_setr_epi8(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE, TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE, TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m256i byte_1_low_table = _mm256_setr_epi8(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+        CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+        CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m256i byte_2_high_table = _mm256_setr_epi8(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+
+    // Input shifted by one, two and three bytes, with the end of the previous block shifted in
+    __m256i carried = _mm256_permute2x128_si256(prev, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, carried, 15);
+    __m256i prev2 = _mm256_alignr_epi8(input, carried, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, carried, 13);
+
+    __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, low_nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // Third and fourth bytes of 3 and 4 byte sequences must be continuations
+    __m256i is_third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i is_fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(is_third, is_fourth), _mm256_set1_epi8((char) 0x80));
+    return _mm256_xor_si256(must_continue, special);
+}
+#endif
+
@@ -1,52 +1,306 @@
 #ifndef FILE_DATA_H
 #define FILE_DATA_H
 
+#include <stdint.h>
+
 #define E_SUCCESS         0
 #define E_INVALID_CHAR    1
+#define E_IN_PROGRESS     2
 #define E_INTERNAL_ERROR -1
 #define E_IO_ERROR       -2
 #define E_INVALID_ARGS   -3
 
+#define FILE_DATA_SLOT_CLASSES 63
+#define FILE_DATA_PENDING_LINES 64
+#define FILE_DATA_LAZY_LOAD_SIZE ((int64_t) 256 * 1024 * 1024)
+#define FILE_LINE_LOOKAHEAD 3
+#define FILE_DATA_TAB_SIZE 4
+
 
 typedef struct FileLine FileLine;
 typedef struct FileNode FileNode;
 typedef struct FileData FileData;
+typedef struct FileBuffer FileBuffer;
+typedef struct FileNodeChunk FileNodeChunk;
+typedef struct FileDataMemoryStats FileDataMemoryStats;
+typedef struct FileDataLoadProgress FileDataLoadProgress;
+typedef struct FileLoader FileLoader;
+typedef struct FileLineIndex FileLineIndex;
+typedef struct FileDataSaveStats FileDataSaveStats;
+typedef struct FileDataDiskState FileDataDiskState;
+typedef enum FileDataSyncPolicy FileDataSyncPolicy;
+typedef enum FileDataCompression FileDataCompression;
+typedef enum FileLineEncoding FileLineEncoding;
+typedef struct FileRowLayout FileRowLayout;
+
+/**
+ * @brief When a save waits for the new file content to reach the disk.
+ * 
+ * FILE_DATA_SYNC_NONE leaves it to the system, FILE_DATA_SYNC_DATA syncs the file before it
+ * replaces the old one and FILE_DATA_SYNC_FULL also syncs the directory after the replace.
+ */
+enum FileDataSyncPolicy
+{
+    FILE_DATA_SYNC_NONE,
+    FILE_DATA_SYNC_DATA,
+    FILE_DATA_SYNC_FULL
+};
+
+/**
+ * @brief Compression of the file on disk.
+ * 
+ * FILE_DATA_COMPRESSION_NONE files are stored as they are, FILE_DATA_COMPRESSION_GZIP files are gzip streams.
+ */
+enum FileDataCompression
+{
+    FILE_DATA_COMPRESSION_NONE,
+    FILE_DATA_COMPRESSION_GZIP
+};
+
+/**
+ * @brief Encoding of the content of a source line.
+ * 
+ * FILE_LINE_ASCII lines have one byte per character, FILE_LINE_UTF8 lines are valid UTF-8
+ * with multibyte characters and FILE_LINE_BINARY lines have bytes that are not valid UTF-8.
+ */
+enum FileLineEncoding
+{
+    FILE_LINE_ASCII,
+    FILE_LINE_UTF8,
+    FILE_LINE_BINARY
+};
+
+/**
+ * @brief FileLine structure that contains information about a display line in FileData.
+ * 
+ * The content is not null terminated, so it should be accessed using the size.
+ * Display lines are split by bytes, so a multibyte character can start on a display line and end on the next one:
+ * if the display line doesn't end the source line, up to FILE_LINE_LOOKAHEAD bytes of the next one follow the content.
+ * 
+ * Tabs extend to the next multiple of FILE_DATA_TAB_SIZE columns from the start of the source line.
+ * Lines with tabs are wrapped by their visual width, visual_start is the visual column of the first byte of the display line
+ * (the same as col_start if the source line has no tabs).
+ */
+struct FileLine
+{
+    int64_t size;
+    int64_t line;
+    int64_t col_start;
+    int64_t visual_start;
+    int endl;
+    int tabs;
+    FileLineEncoding encoding;
+    char *content;
+};
+
+/**
+ * @brief Report of the last save of a FileData structure.
+ */
+struct FileDataSaveStats
+{
+    int64_t bytes_written;
+    double seconds;
+    double bytes_per_second;
+    int in_place;
+};
+
+/**
+ * @brief File last loaded or saved by a FileData structure, used to detect changes made by other programs.
+ * 
+ * The file is exact if its content matches the structure until the first line modified since,
+ * which is false if it was left incomplete by a failed save.
+ */
+struct FileDataDiskState
+{
+    int64_t device;
+    int64_t inode;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int exact;
+};
 
 /**
  * @brief File data structure.
+ * 
+ * The text is stored as a piece table: the loaded file is kept in a read-only original buffer,
+ * edited content is written into an append-only buffer and the source lines are spans
+ * referencing either of them. Bytes are stored verbatim, only new lines separate the source lines;
+ * final_newline is set if the last line ends with a new line, so saves write the file back unchanged.
+ * 
+ * Only source lines are stored. Display lines are computed from the line length and the
+ * number of display columns: each display line of a source line is completed, with the
+ * exception of the last one.
+ * 
+ * Nodes are allocated from a pool of node chunks and writable line slots from the append buffer.
+ * The line being edited is a gap buffer, its slot grows in power of two size classes, the other
+ * edited lines are shrunk to fit their content. Released nodes and slots are kept in free lists for reuse,
+ * so all memory of the structure is released chunk by chunk.
+ * 
+ * Files are indexed in chunks by multiple threads.
+ * 
+ * Files of at least lazy_load_size bytes are memory mapped and indexed on request: lines past the
+ * requested ones are not counted in size and lines until they are needed, the rest of the mapping
+ * (from unindexed) is only read when the file is indexed further or saved.
+ * 
+ * Inside a transaction, shrinking the previously edited lines and updating the current line index
+ * are deferred until the transaction is committed.
+ * 
+ * Files are saved to a temporary file in the same directory, synced according to sync_policy,
+ * which replaces the old file once it is complete. If the file on disk is unchanged and exact,
+ * and the first position modified since it was loaded or saved (modified_line, modified_col) is in its second half,
+ * only the content from this position on is rewritten in place.
+ * 
+ * The loaded file is kept open (original_fd): while it is unchanged and matches the original buffer
+ * (original_disk), saves copy its unchanged parts with copy_file_range instead of writing them from memory.
+ * 
+ * The line lengths of memory mapped files are cached in a sidecar file, written once the whole file is
+ * indexed; when the file is opened again unchanged, lines are indexed from the cache without reading the file.
+ * 
+ * Gzip files are decompressed by a reader thread while the lines decompressed so far are indexed; the original
+ * buffer is then the decompressed content. Saves write the file with the compression it was loaded with
+ * (compression) unless it is changed, compressed files on disk are never exact.
+ * 
+ * The display lines of recently used lines with tabs (their first byte and visual column) are cached in row_layouts,
+ * so coordinates on these lines are translated without scanning them again.
  */
 struct FileData
 {
-    int size;
-    int display_cols;
+    int64_t size;
+    int64_t lines;
+    int64_t display_cols;
     FileNode *start;
     FileNode *end;
     FileNode *current;
-    int current_index;
+    int64_t current_index;
+    FileNode *root;
+    unsigned int seed;
+
+    char *original;
+    int64_t original_size;
+    int final_newline;
+    FileBuffer *append;
+    FileNodeChunk *node_chunks;
+    FileNode *free_nodes;
+    char *free_slots[FILE_DATA_SLOT_CLASSES];
+    FileNode *edit_node;
+    int64_t gap_start;
+    int64_t gap_size;
+
+    int transaction;
+    FileNode *pending_lines[FILE_DATA_PENDING_LINES];
+    int pending_count;
+
+    FileLine display_line;
+    char *display_buffer;
+    int64_t display_buffer_size;
+    FileRowLayout *row_layouts;
+
+    int64_t lazy_load_size;
+    int original_mapped;
+    char *unindexed;
+
+    FileLoader *loader;
+
+    FileDataSyncPolicy sync_policy;
+    FileDataCompression compression;
+    FileDataSaveStats save_stats;
+    FileDataDiskState disk;
+    int64_t modified_line;
+    int64_t modified_col;
+
+    int original_fd;
+    FileDataDiskState original_disk;
+    FileLineIndex *line_index;
 };
 
 /**
- * @brief FileLine structure that contains information about a line in FileData.
+ * @brief Chunk of the append-only buffer of a FileData structure.
  */
-struct FileLine
+struct FileBuffer
 {
-    int size;
-    int line;
-    int col_start;
-    int endl;
-    char *content;
+    FileBuffer *next;
+    int64_t size;
+    int64_t capacity;
+    char data[];
 };
 
-
 /**
- * @brief FileNode stucture that contains FileLines in linked list.
+ * @brief FileNode stucture that contains a source line in linked list.
+ * 
+ * Nodes are also indexed by a treap (ordered by position in the list, heap ordered by priority),
+ * where each node stores the number of nodes and display lines in its subtree,
+ * for logarithmic access by display line index. Source line numbers are not stored,
+ * they are computed from the subtree node counts, so line breaks don't renumber the following nodes.
+ * 
+ * The capacity is the size of the writable content slot in the append buffer owned by the node,
+ * or 0 if the content is a read-only span.
+ * 
+ * The encoding of the content is found when the line is indexed, edited lines are checked again when they are displayed.
+ * The tabs flag is set if the line may contain tabs, so its display lines are found from its visual width,
+ * display_rows is the number of display lines of the node itself.
  */
 struct FileNode
 {
-    FileLine data;
+    char *content;
+    int64_t size;
+    int64_t capacity;
+
     FileNode *prev;
     FileNode *next;
-}; 
+
+    FileNode *parent;
+    FileNode *left;
+    FileNode *right;
+    unsigned int priority;
+    signed char encoding;
+    signed char tabs;
+    int64_t weight;
+    int64_t rows;
+    int64_t display_rows;
+};
+
+/**
+ * @brief Chunk of the FileNode pool of a FileData structure.
+ */
+struct FileNodeChunk
+{
+    FileNodeChunk *next;
+    int size;
+    FileNode nodes[];
+};
+
+/**
+ * @brief Memory usage report of a FileData structure.
+ * 
+ * All values are in bytes, with the exception of the number of lines.
+ * Memory mapped files are read from the page cache, they are reported in mapped_bytes
+ * and are not part of total_bytes; the text of their unchanged lines is not overhead.
+ * cache_bytes holds the display line buffer, the display lines of lines with tabs and the line index cache.
+ */
+struct FileDataMemoryStats
+{
+    int64_t lines;
+    int64_t text_bytes;
+    int64_t original_bytes;
+    int64_t mapped_bytes;
+    int64_t append_bytes;
+    int64_t slot_bytes;
+    int64_t node_bytes;
+    int64_t cache_bytes;
+    int64_t total_bytes;
+    double overhead_per_line;
+};
+
+/**
+ * @brief Progress of a background load.
+ */
+struct FileDataLoadProgress
+{
+    int64_t bytes_read;
+    int64_t total_bytes;
+    double bytes_per_second;
+};
 
 /**
  * @brief Create a file data.
@@ -55,7 +309,7 @@ struct FileNode
  * @param file_data pointer to FileData structure to be initialized
  * @return int 0 for success, 1 for failure
  */
-int create_file_data(int cols, FileData *file_data);
+int create_file_data(int64_t cols, FileData *file_data);
 
 /**
  * @brief Free an initialized FileData structure.
@@ -67,49 +321,145 @@ void free_file_data(FileData *file_data);
 /**
  * @brief Load contents of a file into an initialized FileData structure.
  * 
+ * Gzip files are decompressed on a separate thread, their lines are indexed as they are decompressed.
+ * 
  * @param file_data pointer to initialized FileData structure
  * @param file_name name of the file to be loaded
  * @return int 0 for success, 1 for failure
  */
 int load_file_data(FileData *file_data, const char* file_name);
 
+/**
+ * @brief Start loading a file in the background.
+ * 
+ * The file is read by a separate thread, the structure is filled by @ref file_data_load_poll().
+ * Until the load is finished, the structure contains the lines read so far and must not be modified.
+ * Memory mapped files are loaded right away, gzip files are decompressed by the reader thread.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param file_name name of the file to be loaded
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_load_start(FileData *file_data, const char *file_name);
+
+/**
+ * @brief Index the lines read by a background load and get its progress.
+ * 
+ * On failure, the structure is left empty as after @ref free_file_data().
+ * 
+ * @param file_data pointer to FileData structure being loaded
+ * @param progress output parameter for the load progress, in bytes of the file on disk (can be NULL)
+ * @return int 0 if the load is finished, 2 if it is in progress, < 0 for failure
+ */
+int file_data_load_poll(FileData *file_data, FileDataLoadProgress *progress);
+
+/**
+ * @brief Cancel a background load.
+ * 
+ * The reader thread is stopped and the structure is left empty as after @ref free_file_data().
+ * 
+ * @param file_data pointer to FileData structure being loaded
+ */
+void file_data_load_cancel(FileData *file_data);
+
+/**
+ * @brief Remove the line index cache of a file, if any.
+ * 
+ * @param file_name name of the file
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_remove_line_index(const char *file_name);
+
+/**
+ * @brief Index all lines of a memory mapped file.
+ * 
+ * Lines of memory mapped files are indexed on request, so the line counts of the structure
+ * are complete only after this call.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_index_all(FileData *file_data);
+
 /**
  * @brief Save FileData to file
  * 
+ * The content is written to a temporary file next to the output file, which replaces it
+ * once it is complete, so the output file is never left partially written. Symbolic links
+ * are kept and the permissions of an existing output file are preserved.
+ * 
+ * When saving to the file last loaded or saved, if only its end was modified, the content
+ * from the first modified position is rewritten in place instead.
+ * 
+ * Gzip compressed files (see @ref file_data_set_compression()) are always written whole.
+ * 
  * @param file_data pointer to initialized FileData structure
  * @param file_path path of the output file
  * @return int 0 for success, 1 for failure
  */
 int save_file_data(FileData *file_data, const char* file_path);
 
+/**
+ * @brief Set when saves wait for the new file content to reach the disk.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param policy sync policy (FILE_DATA_SYNC_FULL by default)
+ */
+void file_data_set_sync_policy(FileData *file_data, FileDataSyncPolicy policy);
+
+/**
+ * @brief Set the compression of the files written by the next saves.
+ * 
+ * Loading a file sets the compression it was found with, so compressed files are compressed again when saved.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param compression compression of the saved files
+ */
+void file_data_set_compression(FileData *file_data, FileDataCompression compression);
+
+/**
+ * @brief Get the size and throughput of the last save.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param stats output parameter for the report (all zero if the structure was not saved yet)
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_get_save_stats(FileData *file_data, FileDataSaveStats *stats);
+
 /**
  * @brief Resize the structure of the FileData number of columns.
  * 
+ * Only the display line counts are recomputed, line content is not moved.
+ * 
  * @param file_data pointer to initialized FileData structure
  * @param cols the new number of display columns
  * @return int 0 for success, 1 for failure
  */
-int resize_file_data_col(FileData *file_data, int cols);
+int resize_file_data_col(FileData *file_data, int64_t cols);
 
 /**
  * @brief Set the current file data line.
  * 
  * This is used for faster data access of a specific line.
+ * The current node is the source line containing the display line.
  * 
  * @param file_data pointer to initialized FileData structure
  * @param index FileData line number
  * @return 0 for success, 1 for failure
  */
-int set_file_data_line(FileData *file_data, int index);
+int set_file_data_line(FileData *file_data, int64_t index);
 
 /**
  * @brief Get file data line.
  * 
+ * The display line is computed on request, the returned data is valid until the next call
+ * or until the FileData structure is modified.
+ * 
  * @param file_data pointer to initialized FileData structure
  * @param index FileData line number
  * @return pointer to line data or NULL if index invalid
  */
-const FileLine* get_file_data_line(FileData *file_data, int index);
+const FileLine* get_file_data_line(FileData *file_data, int64_t index);
 
 /**
  * @brief Insert character at position in FileData.
@@ -120,7 +470,22 @@ const FileLine* get_file_data_line(FileData *file_data, int index);
  * @param ins character to be inserted
  * @return int 0 for success, 1 for failure
  */
-int file_data_insert_char(FileData *file_data, int line, int col, char ins);
+int file_data_insert_char(FileData *file_data, int64_t line, int64_t col, char ins);
+
+/**
+ * @brief Insert buffer at position in FileData.
+ * 
+ * The buffer may contain new line characters, the text is spliced in a single pass.
+ * All other bytes are inserted verbatim.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param line position FileData line number
+ * @param col position of insertion on the specified FileData line
+ * @param buffer text to be inserted
+ * @param len length of the buffer
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_insert_buffer(FileData *file_data, int64_t line, int64_t col, const char *buffer, int64_t len);
 
 /**
  * @brief Delete character at position in FileData.
@@ -130,12 +495,45 @@ int file_data_insert_char(FileData *file_data, int line, int col, char ins);
  * @param col position of deletion on the specified FileData line
  * @return int 0 for success, 1 for failure
  */
-int file_data_delete_char(FileData *file_data, int line, int col);
+int file_data_delete_char(FileData *file_data, int64_t line, int64_t col);
+
+/**
+ * @brief Delete range of text from FileData.
+ * 
+ * The range is given in source file coordinates, from the start position (inclusive) to the
+ * stop position (exclusive). A column past the end of a line refers to the start of the next line.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param start_line source file line of the range start
+ * @param start_col source file column of the range start
+ * @param stop_line source file line of the range stop
+ * @param stop_col source file column of the range stop
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_delete_range(FileData *file_data, int64_t start_line, int64_t start_col, int64_t stop_line, int64_t stop_col);
+
+/**
+ * @brief Begin an edit transaction.
+ * 
+ * Transactions can be nested, the deferred updates are done when the outermost one is committed.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_begin_transaction(FileData *file_data);
+
+/**
+ * @brief Commit an edit transaction.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @return int 0 for success, < 0 for failure (no transaction in progress)
+ */
+int file_data_commit_transaction(FileData *file_data);
 
 /**
  * @brief Assert FileData structure integrity.
  * 
- * Check if linked list structure and internal data is correct.
+ * Check if linked list and index tree structure and internal data is correct.
  * The function uses asserts, so the program will end if any condition is not satisfied.
  * 
  * @param file_data pointer to initialized FileData structure
@@ -152,6 +550,69 @@ void file_data_check_integrity(FileData *file_data);
  * @param display_col output parameter for corresponding display column
  * @return int 0 for success, 1 for failure
  */
-int file_data_get_display_coords(FileData *file_data, int source_line, int source_col, int *display_line, int *display_col);
+int file_data_get_display_coords(FileData *file_data, int64_t source_line, int64_t source_col, int64_t *display_line, int64_t *display_col);
+
+/**
+ * @brief Move a source file column to a character boundary of a UTF-8 line.
+ * 
+ * Columns inside a multibyte character are moved to its start or, if forward is set, to the start of the next character.
+ * Columns of other lines are not changed, as each of their bytes is a character.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param source_line index of source file line
+ * @param source_col index of source file column
+ * @param forward move to the next character instead of the start of the current one
+ * @param aligned_col output parameter for the column at the character boundary
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_align_char(FileData *file_data, int64_t source_line, int64_t source_col, int forward, int64_t *aligned_col);
+
+/**
+ * @brief Get the visual column of a source file column, with tabs extended to the next tab stop.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param source_line index of source file line
+ * @param source_col index of source file column (-1 or greater than line length for the end of the line)
+ * @param visual_col output parameter for the visual column
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_get_visual_col(FileData *file_data, int64_t source_line, int64_t source_col, int64_t *visual_col);
+
+/**
+ * @brief Get the source file column shown at a visual column of a source line.
+ * 
+ * A visual column inside a tab is moved to the tab, a visual column past the end of the line to the end of the line.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param source_line index of source file line
+ * @param visual_col visual column
+ * @param source_col output parameter for the source file column
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_get_visual_source_col(FileData *file_data, int64_t source_line, int64_t visual_col, int64_t *source_col);
+
+/**
+ * @brief Get source file coords corresponding to display info
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param display_line index of display line
+ * @param display_col index of display column
+ * @param source_line output parameter for corresponding source file line
+ * @param source_col output parameter for corresponding source file column
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_get_source_coords(FileData *file_data, int64_t display_line, int64_t display_col, int64_t *source_line, int64_t *source_col);
+
+/**
+ * @brief Get memory usage of FileData structure.
+ * 
+ * The overhead per line is the memory used by the structure in addition to the text of the
+ * source lines (line content, without newline characters), divided by the number of lines.
+ * 
+ * @param file_data pointer to initialized FileData structure
+ * @param stats output parameter for the memory usage report
+ * @return int 0 for success, < 0 for failure
+ */
+int file_data_get_memory_stats(FileData *file_data, FileDataMemoryStats *stats);
 
 #endif // FILE_DATA_H
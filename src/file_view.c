@@ -1,8 +1,13 @@
+#define _GNU_SOURCE
+
 #include "file_view.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <libgen.h>
+#include <inttypes.h>
+#include <wchar.h>
+#include <langinfo.h>
 #include "colors.h"
 
 
@@ -59,7 +64,68 @@ int file_view_set_file_path(FileView *view, const char* file_path);
  * @param sel_stop_line stop source line
  * @param sel_stop_col stop source col
  */
-void file_view_get_selection_ranges(FileView *view, int *sel_start_line, int *sel_start_col, int *sel_stop_line, int *sel_stop_col);
+void file_view_get_selection_ranges(FileView *view, int64_t *sel_start_line, int64_t *sel_start_col, int64_t *sel_stop_line, int64_t *sel_stop_col);
+
+/**
+ * @brief Get the character displayed for a byte of the file content.
+ * 
+ * Bytes that can't be displayed are shown in a single cell as escapes, in the marker color:
+ * control characters as their caret notation letter (^M as M) and bytes above 127 as a checkerboard.
+ * Tabs are expanded to the next tab stop by the caller.
+ * 
+ * @param ch byte of the file content
+ * @return chtype character to be displayed
+ */
+chtype display_char(unsigned char ch);
+
+/**
+ * @brief Check if the terminal displays UTF-8 characters.
+ * 
+ * The locale is set at startup, the result is computed once.
+ * 
+ * @return int 1 if the locale encoding is UTF-8, 0 otherwise
+ */
+int display_utf8(void);
+
+/**
+ * @brief Get the length of a UTF-8 sequence from its first byte.
+ * 
+ * @param lead first byte of the sequence
+ * @return int sequence length, 0 for continuation bytes and bytes that can't start a sequence
+ */
+int utf8_char_size(unsigned char lead);
+
+/**
+ * @brief Decode a character of a valid UTF-8 display line.
+ * 
+ * @param content pointer to the first byte of the character
+ * @param wc output parameter for the decoded character
+ * @return int number of bytes of the character
+ */
+int decode_char(const char *content, wchar_t *wc);
+
+/**
+ * @brief Get the first column of a display line starting a character.
+ * 
+ * Characters wrapped at the end of a display line are shown on the line where they start,
+ * their bytes at the start of the next display line are skipped.
+ * 
+ * @param line pointer to display line
+ * @return int display column of the first character
+ */
+int row_start(const FileLine *line);
+
+/**
+ * @brief Get the screen column of a display line column.
+ * 
+ * Lines which are not UTF-8 and have no tabs take a cell for each byte, so the column is returned directly.
+ * Tabs extend to the next multiple of FILE_DATA_TAB_SIZE, counted from the start of the source line.
+ * 
+ * @param line pointer to display line
+ * @param col display column (byte offset in the display line)
+ * @return int screen column
+ */
+int display_x(const FileLine *line, int col);
 
 
 // ----------------------- Public definitions -----------------------
@@ -132,31 +198,64 @@ void free_file_view(FileView *view)
 
 int file_view_load_file(FileView *view, const char* file_path)
 {
-    view->status = FILE_VIEW_STATUS_UNINITIALIZED;
+    view->status = FILE_VIEW_STATUS_LOADING;
+    memset(&view->save_stats, 0, sizeof(view->save_stats));
 
-    // Try to load file into data structure
-    int res = load_file_data(view->data, file_path);
+    // Reset positions
+    view->pos_x = 0;
+    view->pos_y = 0;
+    view->scroll_offset = 0;
+
+    // Start loading file into data structure in the background
+    int res = file_data_load_start(view->data, file_path);
 
     if (res < 0)
     {
+        view->status = FILE_VIEW_STATUS_UNINITIALIZED;
         return res;
     }
 
     // Update tab name and file path
     if (file_view_set_file_path(view, file_path) != 0)
     {
+        file_data_load_cancel(view->data);
+        view->status = FILE_VIEW_STATUS_UNINITIALIZED;
         return E_INTERNAL_ERROR;
     }
 
-    // Reset positions
-    view->pos_x = 0;
-    view->pos_y = 0;
-    view->scroll_offset = 0;
+    return file_view_load_poll(view);
+}
 
-    // Update status
-    view->status = FILE_VIEW_STATUS_SAVED;
+int file_view_load_poll(FileView *view)
+{
+    if (view->status != FILE_VIEW_STATUS_LOADING)
+    {
+        return E_SUCCESS;
+    }
 
-    return E_SUCCESS;
+    int res = file_data_load_poll(view->data, &view->load_progress);
+
+    if (res < 0)
+    {
+        view->status = FILE_VIEW_STATUS_UNINITIALIZED;
+        return res;
+    }
+
+    if (res == E_SUCCESS)
+    {
+        view->status = FILE_VIEW_STATUS_SAVED;
+    }
+
+    return res;
+}
+
+void file_view_cancel_load(FileView *view)
+{
+    if (view->status == FILE_VIEW_STATUS_LOADING)
+    {
+        file_data_load_cancel(view->data);
+        view->status = FILE_VIEW_STATUS_UNINITIALIZED;
+    }
 }
 
 int file_view_save_file(FileView *view, const char* file_path)
@@ -168,6 +267,14 @@ int file_view_save_file(FileView *view, const char* file_path)
         return E_INTERNAL_ERROR;
     }
 
+    // Saving as a new file compresses it if it's named like a gzip file
+    if (file_path != NULL)
+    {
+        size_t len = strlen(file_path);
+        int gzip = len > 3 && strcmp(file_path + len - 3, ".gz") == 0;
+        file_data_set_compression(view->data, gzip ? FILE_DATA_COMPRESSION_GZIP : FILE_DATA_COMPRESSION_NONE);
+    }
+
     int ret = save_file_data(view->data, save_file_path);
 
     if (ret < 0)
@@ -184,6 +291,7 @@ int file_view_save_file(FileView *view, const char* file_path)
         }
     }
 
+    file_data_get_save_stats(view->data, &view->save_stats);
     view->status = FILE_VIEW_STATUS_SAVED;
     return E_SUCCESS;
 }
@@ -194,7 +302,7 @@ void file_view_render(FileView *view)
     getmaxyx(view->win, height, width);
 
     int start_sel = 0;
-    int sel_start_line, sel_start_col, sel_stop_line, sel_stop_col;
+    int64_t sel_start_line, sel_start_col, sel_stop_line, sel_stop_col;
     file_view_get_selection_ranges(view, &sel_start_line, &sel_start_col, &sel_stop_line, &sel_stop_col);
 
     for (int i = 0; i < height; i++)
@@ -202,11 +310,15 @@ void file_view_render(FileView *view)
         if (i + view->scroll_offset < view->data->size)
         {
             const FileLine *line = get_file_data_line(view->data, i + view->scroll_offset);
-            int source_line = line->line;
-            int source_col = line->col_start;
+            int64_t source_line = line->line;
+            int64_t source_col = line->col_start;
+
+            // Multibyte characters are decoded only on UTF-8 lines
+            int utf8 = line->encoding == FILE_LINE_UTF8 && display_utf8();
+            int64_t x = line->visual_start;
 
             wmove(view->win, i, 0);
-            for (int col = 0; col < line->size; col++)
+            for (int col = utf8 ? row_start(line) : 0; col < line->size;)
             {
                 if (source_line == sel_start_line && source_col + col == sel_start_col)
                 {
@@ -219,12 +331,41 @@ void file_view_render(FileView *view)
                 }
 
                 int mod = start_sel ? A_STANDOUT : 0;
-                int ch = line->content[col];
-                if (ch == '\t')
+                if (line->content[col] == '\t')
+                {
+                    // Spaces up to the next tab stop, clipped to the window
+                    int64_t stop = (x / FILE_DATA_TAB_SIZE + 1) * FILE_DATA_TAB_SIZE;
+                    for (; x < stop && x - line->visual_start < width; x++)
+                    {
+                        waddch(view->win, ' ' | mod);
+                    }
+                    x = stop;
+                    col++;
+                }
+                else if (utf8 && (unsigned char) line->content[col] > 127)
+                {
+                    wchar_t wch[2] = {0, 0};
+                    col += decode_char(line->content + col, &wch[0]);
+
+                    cchar_t cch;
+                    int char_width = wcwidth(wch[0]);
+                    if (char_width < 0 || setcchar(&cch, wch, mod, 0, NULL) == ERR)
+                    {
+                        waddch(view->win, ACS_CKBOARD | COLOR_PAIR(MARKER_COLOR) | mod);
+                        x++;
+                    }
+                    else
+                    {
+                        wadd_wch(view->win, &cch);
+                        x += char_width;
+                    }
+                }
+                else
                 {
-                    ch = ACS_RARROW | COLOR_PAIR(MARKER_COLOR);
+                    waddch(view->win, display_char((unsigned char) line->content[col]) | mod);
+                    col++;
+                    x++;
                 }
-                waddch(view->win, ch | mod);
             }
 
             if (source_line == sel_start_line && source_col + line->size == sel_start_col)
@@ -242,7 +383,8 @@ void file_view_render(FileView *view)
                 waddch(view->win, ' ' | A_STANDOUT);
             }
 
-            if (!line->endl)
+            // A wide character at the end of the display line may take the marker cell
+            if (!line->endl && display_x(line, line->size) < width)
             {
                 wattron(view->win, COLOR_PAIR(MARKER_COLOR));
                 mvwaddch(view->win, i, width - 1, '>');
@@ -259,7 +401,8 @@ void file_view_render(FileView *view)
     }
 
     const FileLine *current_line = get_file_data_line(view->data, view->scroll_offset + view->pos_y);
-    if (current_line != NULL)
+    int cursor_x = current_line != NULL ? display_x(current_line, view->pos_x) : view->pos_x;
+    if (current_line != NULL || view->status == FILE_VIEW_STATUS_LOADING)
     {
         // mvwprintw(view->win, height - 1, 0, "(d x: %d, d y: %d, i: %d, s line: %d, s col: %d, size: %d, endl: %d, status: %d, sel_start: %d, %d; sel_stop: %d, %d)", view->pos_x, view->pos_y, view->pos_y + view->scroll_offset, current_line->line, current_line->col_start + view->pos_x, current_line->size, current_line->endl, view->status, sel_start_line, sel_start_col, sel_stop_line, sel_stop_col);
         char *message;
@@ -274,6 +417,10 @@ void file_view_render(FileView *view)
                 message = "Saved";
                 break;
 
+            case FILE_VIEW_STATUS_LOADING:
+                message = "Loading";
+                break;
+
             default:
                 message = "";
                 break;
@@ -291,16 +438,33 @@ void file_view_render(FileView *view)
         // Render status bar
         wmove(view->win, height - 1, 0);
         wprintw(view->win, " %s ", message);
-        waddch(view->win, ACS_VLINE);
-        wprintw(view->win, " Line: %d ", current_line->line);
-        waddch(view->win, ACS_VLINE);
-        wprintw(view->win, " Col: %d", current_line->col_start + view->pos_x);
+        if (current_line != NULL)
+        {
+            waddch(view->win, ACS_VLINE);
+            wprintw(view->win, " Line: %" PRId64 " ", current_line->line);
+            waddch(view->win, ACS_VLINE);
+            int64_t col = current_line->tabs ? current_line->visual_start + cursor_x : current_line->col_start + view->pos_x;
+            wprintw(view->win, " Col: %" PRId64 " ", col);
+        }
+
+        if (view->status == FILE_VIEW_STATUS_LOADING)
+        {
+            const FileDataLoadProgress *progress = &view->load_progress;
+            waddch(view->win, ACS_VLINE);
+            wprintw(view->win, " %.1f / %.1f MB, %.1f MB/s (Esc to cancel)", progress->bytes_read / 1048576.0, progress->total_bytes / 1048576.0, progress->bytes_per_second / 1048576.0);
+        }
+        else if (view->status == FILE_VIEW_STATUS_SAVED && view->save_stats.bytes_written > 0)
+        {
+            const FileDataSaveStats *stats = &view->save_stats;
+            waddch(view->win, ACS_VLINE);
+            wprintw(view->win, " %.1f MB, %.1f MB/s ", stats->bytes_written / 1048576.0, stats->bytes_per_second / 1048576.0);
+        }
 
         wattroff(view->win, A_STANDOUT);
     }
 
     // Update cursor position
-    wmove(view->win, view->pos_y, view->pos_x);
+    wmove(view->win, view->pos_y, cursor_x);
     wrefresh(view->win);
 }
 
@@ -334,7 +498,21 @@ int file_view_handle_input(FileView *view, int input)
     int res = 1;
     int cursor_move = 0;
     int modified = 0;
-    int temp_pos_x = view->pos_x, temp_pos_y = view->pos_y;
+    int64_t temp_pos_x = view->pos_x, temp_pos_y = view->pos_y;
+    int64_t source_line, source_col, char_size = 1;
+
+    // File can only be viewed while it is loading
+    if (view->status == FILE_VIEW_STATUS_LOADING && input != KEY_UP && input != KEY_DOWN &&
+        input != KEY_LEFT && input != KEY_RIGHT && input != KEY_HOME && input != KEY_END)
+    {
+        return E_SUCCESS;
+    }
+
+    // Any other input interrupts a multibyte character being typed
+    if (input < 128 || input > 255)
+    {
+        view->input_size = 0;
+    }
 
     if (input == KEY_BACKSPACE)
     {
@@ -344,19 +522,29 @@ int file_view_handle_input(FileView *view, int input)
             return file_view_delete_selection(view);
         }
 
-        const FileLine *line = get_file_data_line(view->data, view->scroll_offset + view->pos_y);
-        if (line == NULL)
+        if (file_data_get_source_coords(view->data, view->scroll_offset + view->pos_y, view->pos_x, &source_line, &source_col) < 0)
         {
             return E_INTERNAL_ERROR;
         }
 
-        int source_line = line->line;
-        int source_col = line->col_start + view->pos_x - 1;
+        source_col--;
 
         if (source_col == -1)
         {
             source_line--;
         }
+        else
+        {
+            // The whole previous character is deleted
+            int64_t char_start;
+            if (file_data_align_char(view->data, source_line, source_col, 0, &char_start) < 0)
+            {
+                return E_INTERNAL_ERROR;
+            }
+
+            char_size = source_col + 1 - char_start;
+            source_col = char_start;
+        }
         
         if (file_data_get_display_coords(view->data, source_line, source_col, &temp_pos_y, &temp_pos_x) < 0)
         {
@@ -397,18 +585,44 @@ int file_view_handle_input(FileView *view, int input)
             break;
 
         case KEY_BACKSPACE:
-            res = file_data_delete_char(view->data, view->pos_y + view->scroll_offset, view->pos_x - 1);
+            if (char_size > 1)
+            {
+                res = file_data_delete_range(view->data, source_line, source_col, source_line, source_col + char_size);
+            }
+            else
+            {
+                res = file_data_delete_char(view->data, view->pos_y + view->scroll_offset, view->pos_x - 1);
+            }
             cursor_move = KEY_BACKSPACE;
             modified = 1;
             break;
 
         default:
-            if ((char) input == input)
+            if (input == '\t' || (input >= ' ' && input < 127))
             {
                 res = file_data_insert_char(view->data, view->pos_y + view->scroll_offset, view->pos_x, (char) input);
                 cursor_move = KEY_RIGHT;
                 modified = 1;
             }
+            else if (input > 127 && input < 256)
+            {
+                // Bytes of a multibyte character are inserted together
+                if (view->input_size == 0 && utf8_char_size((unsigned char) input) < 2)
+                {
+                    break;
+                }
+
+                view->input_char[view->input_size++] = (char) input;
+                if (view->input_size > 1 && ((unsigned char) input & 0xC0) != 0x80)
+                {
+                    view->input_size = 0;
+                }
+                else if (view->input_size == utf8_char_size((unsigned char) view->input_char[0]))
+                {
+                    view->input_size = 0;
+                    return file_view_insert_buffer(view, view->input_char, utf8_char_size((unsigned char) view->input_char[0]));
+                }
+            }
             break;
     }
 
@@ -434,18 +648,68 @@ int file_view_handle_input(FileView *view, int input)
         return E_INTERNAL_ERROR;
     }
 
-    // FIXME: temporary for debug
+#ifdef FILE_DATA_DEBUG
+    file_data_check_integrity(view->data);
+#endif
+
+    return E_SUCCESS;
+}
+
+int file_view_insert_buffer(FileView *view, const char *buffer, int64_t len)
+{
+    int64_t source_line, source_col;
+    if (file_data_get_source_coords(view->data, view->scroll_offset + view->pos_y, view->pos_x, &source_line, &source_col) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    int res = file_data_insert_buffer(view->data, view->pos_y + view->scroll_offset, view->pos_x, buffer, len);
+    if (res != E_SUCCESS)
+    {
+        return res < E_SUCCESS ? E_INTERNAL_ERROR : E_SUCCESS;
+    }
+
+    // Cursor moves to the end of the inserted text
+    for (int64_t i = 0; i < len; i++)
+    {
+        if (buffer[i] == '\n')
+        {
+            source_line++;
+            source_col = 0;
+        }
+        else
+        {
+            source_col++;
+        }
+    }
+
+    int64_t pos_x, pos_y;
+    if (file_data_get_display_coords(view->data, source_line, source_col, &pos_y, &pos_x) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
+
+    view->pos_x = pos_x;
+    view->pos_y = pos_y - view->scroll_offset;
+    view->sel_active = 0;
+    update_cursor_position(view, 0);
+    update_selection(view);
+    view->status = FILE_VIEW_STATUS_MODIFIED;
+
+#ifdef FILE_DATA_DEBUG
     file_data_check_integrity(view->data);
+#endif
 
     return E_SUCCESS;
 }
 
-int file_view_copy_selection(FileView *view, char **buffer, int *len)
+int file_view_copy_selection(FileView *view, char **buffer, int64_t *len)
 {
-    int sel_start_line, sel_start_col, sel_stop_line, sel_stop_col;
+    int64_t sel_start_line, sel_start_col, sel_stop_line, sel_stop_col;
     int line_cols = getmaxx(view->win) - 1;
     file_view_get_selection_ranges(view, &sel_start_line, &sel_start_col, &sel_stop_line, &sel_stop_col);
-    int size = (sel_stop_line - sel_start_line + 1) * line_cols;
+    // Initial estimate of one display line for each source line, grown for wrapped lines
+    int64_t size = (sel_stop_line - sel_start_line + 1) * line_cols;
 
     *buffer = (char*) malloc(size * sizeof(char));
     if (*buffer == NULL)
@@ -453,15 +717,38 @@ int file_view_copy_selection(FileView *view, char **buffer, int *len)
         return E_INTERNAL_ERROR;
     }
 
+    // Start from the display line containing the selection start
+    int64_t start_row, start_col;
+    if (file_data_get_display_coords(view->data, sel_start_line, sel_start_col, &start_row, &start_col) < 0)
+    {
+        free(*buffer);
+        *buffer = NULL;
+        return E_INTERNAL_ERROR;
+    }
+
     int start_sel = 0;
     *len = 0;
-    for (int i = 0; i < view->data->size; i++)
+    for (int64_t i = start_row; i < view->data->size; i++)
     {
         const FileLine *line = get_file_data_line(view->data, i);
-        int source_line = line->line;
-        int source_col = line->col_start;
+        int64_t source_line = line->line;
+        int64_t source_col = line->col_start;
 
-        for (int col = 0; col < line->size; col++)
+        // Wrapped source lines span several display lines, the buffer grows to fit the display line and its new line
+        if (*len + line->size + 1 > size)
+        {
+            size = 2 * size > *len + line->size + 1 ? 2 * size : *len + line->size + 1;
+            char *new_buffer = (char*) realloc(*buffer, size * sizeof(char));
+            if (new_buffer == NULL)
+            {
+                free(*buffer);
+                *buffer = NULL;
+                return E_INTERNAL_ERROR;
+            }
+            *buffer = new_buffer;
+        }
+
+        for (int64_t col = 0; col < line->size; col++)
         {
             if (source_line == sel_start_line && source_col + col == sel_start_col)
             {
@@ -491,8 +778,8 @@ int file_view_copy_selection(FileView *view, char **buffer, int *len)
             return E_SUCCESS;
         }
 
-        // Append new line to selection
-        if (start_sel)
+        // Append new line to selection (wrapped display lines continue the source line)
+        if (start_sel && line->endl)
         {
             (*buffer)[*len] = '\n';
             (*len)++;
@@ -504,29 +791,40 @@ int file_view_copy_selection(FileView *view, char **buffer, int *len)
 
 int file_view_delete_selection(FileView *view)
 {
-    int sel_start_line, sel_start_col, sel_stop_line, sel_stop_col;
+    int64_t sel_start_line, sel_start_col, sel_stop_line, sel_stop_col;
     file_view_get_selection_ranges(view, &sel_start_line, &sel_start_col, &sel_stop_line, &sel_stop_col);
 
-    int source_line = sel_stop_line, source_col = sel_stop_col;
-    int pos_x, pos_y;
-    if (file_data_get_display_coords(view->data, source_line, source_col, &pos_y, &pos_x) < 0)
+    if (file_data_delete_range(view->data, sel_start_line, sel_start_col, sel_stop_line, sel_stop_col) < 0)
     {
         return E_INTERNAL_ERROR;
     }
 
-    view->pos_x = pos_x;
-    view->pos_y = pos_y - view->scroll_offset;
-    update_cursor_position(view, KEY_BACKSPACE);
+    // Cursor moves to the start of the deleted range
+    int64_t pos_x, pos_y, source_line, source_col;
+    if (file_data_get_display_coords(view->data, sel_start_line, sel_start_col, &pos_y, &pos_x) < 0 ||
+        file_data_get_source_coords(view->data, pos_y, pos_x, &source_line, &source_col) < 0)
+    {
+        return E_INTERNAL_ERROR;
+    }
 
-    while(source_line != sel_start_line || source_col != sel_start_col)
+    // A selection starting past the end of a line starts on the next line
+    if (source_col < sel_start_col && sel_start_line + 1 < view->data->lines &&
+        file_data_get_display_coords(view->data, sel_start_line + 1, 0, &pos_y, &pos_x) < 0)
     {
-        file_view_handle_input(view, KEY_BACKSPACE);
-        file_view_render(view);
-        const FileLine *line = get_file_data_line(view->data, view->pos_y + view->scroll_offset);
-        source_line = line->line;
-        source_col = line->col_start + view->pos_x;
+        return E_INTERNAL_ERROR;
     }
 
+    view->pos_x = pos_x;
+    view->pos_y = pos_y - view->scroll_offset;
+    view->sel_active = 0;
+    update_cursor_position(view, 0);
+    update_selection(view);
+    view->status = FILE_VIEW_STATUS_MODIFIED;
+
+#ifdef FILE_DATA_DEBUG
+    file_data_check_integrity(view->data);
+#endif
+
     return E_SUCCESS;
 }
 
@@ -568,29 +866,30 @@ void update_cursor_position(FileView *view, int input)
     // Get window dimensions
     int height = getmaxy(view->win);
 
-    const FileLine *current_line = get_file_data_line(view->data, view->scroll_offset + view->pos_y);
-
-    if (current_line == NULL)
+    // Position in source file context
+    int64_t source_line, source_col;
+    if (file_data_get_source_coords(view->data, view->scroll_offset + view->pos_y, view->pos_x, &source_line, &source_col) < 0)
     {
         view->pos_x = 0;
         view->pos_y = 0;
         return;
     }
 
-    // Position in source file context
-    int source_line = current_line->line;
-    int source_col = current_line->col_start + view->pos_x;
-
+    int64_t next_line, next_col, visual_col;
     switch(input)
     {
         case KEY_UP:
         case KEY_SR:
-            source_line--;
-            break;
-
         case KEY_DOWN:
         case KEY_SF:
-            source_line++;
+            // Cursor keeps its visual column on lines with tabs
+            next_line = input == KEY_UP || input == KEY_SR ? source_line - 1 : source_line + 1;
+            if (file_data_get_visual_col(view->data, source_line, source_col, &visual_col) == E_SUCCESS &&
+                file_data_get_visual_source_col(view->data, next_line, visual_col, &next_col) == E_SUCCESS)
+            {
+                source_col = next_col;
+            }
+            source_line = next_line;
             break;
 
         case KEY_LEFT:
@@ -622,8 +921,16 @@ void update_cursor_position(FileView *view, int input)
             break;
     }
 
+    // Cursor stays on the character boundaries of UTF-8 lines
+    int64_t aligned_col;
+    int forward = input == KEY_RIGHT || input == KEY_SRIGHT;
+    if (file_data_align_char(view->data, source_line, source_col, forward, &aligned_col) == E_SUCCESS)
+    {
+        source_col = aligned_col;
+    }
+
     // Get coresponding position in display file context
-    int temp_x, temp_y;
+    int64_t temp_x, temp_y;
     if (file_data_get_display_coords(view->data, source_line, source_col, &temp_y, &temp_x) == 0)
     {
         view->pos_y = temp_y - view->scroll_offset;
@@ -646,20 +953,20 @@ void update_cursor_position(FileView *view, int input)
 
 void update_selection(FileView *view)
 {
-    const FileLine *line = get_file_data_line(view->data, view->scroll_offset + view->pos_y);
-    if (line == NULL)
+    int64_t source_line, source_col;
+    if (file_data_get_source_coords(view->data, view->scroll_offset + view->pos_y, view->pos_x, &source_line, &source_col) < 0)
     {
         return;
     }
     
     if (!view->sel_active)
     {
-        view->sel_start_line = line->line;
-        view->sel_start_col = view->pos_x + line->col_start;
+        view->sel_start_line = source_line;
+        view->sel_start_col = source_col;
     }
 
-    view->sel_stop_line = line->line;
-    view->sel_stop_col = view->pos_x + line->col_start;
+    view->sel_stop_line = source_line;
+    view->sel_stop_col = source_col;
 }
 
 int file_view_set_file_path(FileView *view, const char* file_path)
@@ -704,7 +1011,7 @@ int file_view_set_file_path(FileView *view, const char* file_path)
     return E_SUCCESS;
 }
 
-void file_view_get_selection_ranges(FileView *view, int *sel_start_line, int *sel_start_col, int *sel_stop_line, int *sel_stop_col)
+void file_view_get_selection_ranges(FileView *view, int64_t *sel_start_line, int64_t *sel_start_col, int64_t *sel_stop_line, int64_t *sel_stop_col)
 {
     *sel_start_line = view->sel_start_line;
     *sel_start_col = view->sel_start_col;
@@ -715,8 +1022,135 @@ void file_view_get_selection_ranges(FileView *view, int *sel_start_line, int *se
     if ((*sel_stop_line < *sel_start_line) || (*sel_stop_line == *sel_start_line && *sel_stop_col < *sel_start_col))
     {
         *sel_start_line = view->sel_stop_line;
-        *sel_start_col = view->sel_stop_col + 1;
         *sel_stop_line = view->sel_start_line;
-        *sel_stop_col = view->sel_start_col + 1;
+
+        // The character under the cursor is selected, up to the start of the next one
+        if (file_data_align_char(view->data, view->sel_stop_line, view->sel_stop_col + 1, 1, sel_start_col) < 0)
+        {
+            *sel_start_col = view->sel_stop_col + 1;
+        }
+
+        if (file_data_align_char(view->data, view->sel_start_line, view->sel_start_col + 1, 1, sel_stop_col) < 0)
+        {
+            *sel_stop_col = view->sel_start_col + 1;
+        }
     }
 }
+
+chtype display_char(unsigned char ch)
+{
+    if (ch < ' ' || ch == 127)
+    {
+        return (ch ^ 0x40) | COLOR_PAIR(MARKER_COLOR);
+    }
+
+    if (ch > 127)
+    {
+        return ACS_CKBOARD | COLOR_PAIR(MARKER_COLOR);
+    }
+
+    return ch;
+}
+
+int display_utf8(void)
+{
+    static int utf8 = -1;
+    if (utf8 < 0)
+    {
+        utf8 = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+    }
+
+    return utf8;
+}
+
+int utf8_char_size(unsigned char lead)
+{
+    if (lead < 0x80)
+    {
+        return 1;
+    }
+
+    if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        return 2;
+    }
+
+    if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        return 3;
+    }
+
+    if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        return 4;
+    }
+
+    return 0;
+}
+
+int decode_char(const char *content, wchar_t *wc)
+{
+    int size = utf8_char_size((unsigned char) content[0]);
+    if (size < 2)
+    {
+        *wc = (unsigned char) content[0];
+        return 1;
+    }
+
+    // Payload bits of the first byte, followed by 6 bits of each continuation byte
+    *wc = (unsigned char) content[0] & (0x7F >> size);
+    for (int i = 1; i < size; i++)
+    {
+        *wc = (*wc << 6) | ((unsigned char) content[i] & 0x3F);
+    }
+
+    return size;
+}
+
+int row_start(const FileLine *line)
+{
+    int col = 0;
+    while (col < line->size && ((unsigned char) line->content[col] & 0xC0) == 0x80)
+    {
+        col++;
+    }
+
+    return col;
+}
+
+int display_x(const FileLine *line, int col)
+{
+    // ASCII and binary lines take a cell for each byte
+    int utf8 = line->encoding == FILE_LINE_UTF8 && display_utf8();
+    if (!utf8 && !line->tabs)
+    {
+        return col;
+    }
+
+    // Tab stops are relative to the visual column of the display line start
+    int64_t x = line->visual_start;
+    for (int i = utf8 ? row_start(line) : 0; i < col && i < line->size;)
+    {
+        if (line->content[i] == '\t')
+        {
+            x = (x / FILE_DATA_TAB_SIZE + 1) * FILE_DATA_TAB_SIZE;
+            i++;
+            continue;
+        }
+
+        if (!utf8 || (unsigned char) line->content[i] < 0x80)
+        {
+            x++;
+            i++;
+            continue;
+        }
+
+        wchar_t wc;
+        i += decode_char(line->content + i, &wc);
+
+        int width = wcwidth(wc);
+        x += width < 0 ? 1 : width;
+    }
+
+    return x - line->visual_start;
+}
@@ -5,6 +5,7 @@
 #include "file_data.h"
 
 #define E_SUCCESS         0
+#define E_IN_PROGRESS     2
 #define E_INTERNAL_ERROR -1
 #define E_IO_ERROR       -2
 #define E_INVALID_ARGS   -3
@@ -17,7 +18,8 @@ enum FileViewStatus
     FILE_VIEW_STATUS_UNINITIALIZED,
     FILE_VIEW_STATUS_NEW_FILE,
     FILE_VIEW_STATUS_MODIFIED,
-    FILE_VIEW_STATUS_SAVED
+    FILE_VIEW_STATUS_SAVED,
+    FILE_VIEW_STATUS_LOADING
 };
 
 struct FileView
@@ -30,15 +32,21 @@ struct FileView
     FileData *data;
     FileViewStatus status;
 
-    int scroll_offset;
+    int64_t scroll_offset;
     int pos_x;
     int pos_y;
 
     int sel_active;
-    int sel_start_line;
-    int sel_start_col;
-    int sel_stop_line;
-    int sel_stop_col;
+    int64_t sel_start_line;
+    int64_t sel_start_col;
+    int64_t sel_stop_line;
+    int64_t sel_stop_col;
+
+    char input_char[4];
+    int input_size;
+
+    FileDataLoadProgress load_progress;
+    FileDataSaveStats save_stats;
 };
 
 /**
@@ -63,14 +71,31 @@ FileView* create_file_view(int height, int width, int offset_y, int offset_x);
 void free_file_view(FileView *view);
 
 /**
- * @brief Load contents of file into data.
+ * @brief Start loading contents of file into data.
+ * 
+ * The file is loaded in the background, the load is continued by @ref file_view_load_poll().
  * 
  * @param view pointer to initialized FileView structure
  * @param file_name name of the file to be loaded
- * @return int 0 for success, 1 for failure
+ * @return int 0 if the file is loaded, 2 if the load is in progress, < 0 for failure
  */
 int file_view_load_file(FileView *view, const char *file_name);
 
+/**
+ * @brief Add the lines read so far to the view of a file being loaded and update the load progress.
+ * 
+ * @param view pointer to initialized FileView structure
+ * @return int 0 if the file is loaded, 2 if the load is in progress, < 0 for failure
+ */
+int file_view_load_poll(FileView *view);
+
+/**
+ * @brief Cancel the load of a file, the view data is left empty.
+ * 
+ * @param view pointer to initialized FileView structure
+ */
+void file_view_cancel_load(FileView *view);
+
 /**
  * @brief Save file data into file.
  * 
@@ -107,6 +132,18 @@ int file_view_handle_resize(FileView *view, int height, int width, int offset_y,
  */
 int file_view_handle_input(FileView *view, int input);
 
+/**
+ * @brief Insert buffer at cursor position.
+ * 
+ * The cursor is moved to the end of the inserted text.
+ * 
+ * @param view pointer to initialized FileView structure
+ * @param buffer text to be inserted
+ * @param len length of the buffer
+ * @return int 0 for success, < 0 for failure
+ */
+int file_view_insert_buffer(FileView *view, const char *buffer, int64_t len);
+
 /**
  * @brief Copy view selection to buffer.
  * 
@@ -117,7 +154,7 @@ int file_view_handle_input(FileView *view, int input);
  * @param len selection length copied into buffer
  * @return int 
  */
-int file_view_copy_selection(FileView *view, char **buffer, int *len);
+int file_view_copy_selection(FileView *view, char **buffer, int64_t *len);
 
 /**
  * @brief Delete selection from view.
@@ -12,7 +12,7 @@
  * - make clean
  * 
  * Application components:
- * - FileData: represents the file as a linked list of display lines
+ * - FileData: represents the file as a linked list of source lines (display lines are computed)
  * - FileView: handles the view of a file tab (rendering and file input)
  * - TextEditor: renders the whole application and manages file tabs and application menu
  * - Dialogs: utilities to display dialogs (text input, confirm and alert)
@@ -23,9 +23,13 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <locale.h>
 
 int main()
 {
+    // Use the terminal encoding to display UTF-8 files
+    setlocale(LC_ALL, "");
+
     // Initialize ncurses
     initscr();
     start_color();
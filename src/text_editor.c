@@ -19,6 +19,8 @@
 #define FILE_VIEW_OFFSET_X 0
 
 #define PATH_INPUT_BUFFER_LEN 256
+#define LOAD_POLL_INTERVAL 100
+#define LOAD_CANCELED 1
 
 #define KEY_RETURN '\n'
 #define KEY_ESC 27
@@ -91,6 +93,17 @@ void text_editor_render_about_window(TextEditor *editor);
  */
 void text_editor_update_menu_options(TextEditor *editor);
 
+/**
+ * @brief Wait for the background load of a file view, rendering the lines loaded so far.
+ * 
+ * The loaded lines can be viewed while waiting, Esc cancels the load.
+ * 
+ * @param editor pointer to initialized TextEditor structure
+ * @param view pointer to the FileView being loaded
+ * @return int 0 if the file is loaded, LOAD_CANCELED if the load was canceled, < 0 for failure
+ */
+int text_editor_wait_load(TextEditor *editor, FileView *view);
+
 /**
  * @brief Execute file menu action.
  * 
@@ -360,8 +373,18 @@ int text_editor_load_file(TextEditor *editor)
         return E_INTERNAL_ERROR;
     }
 
-    
-    int ret = file_view_load_file(editor->tabs[editor->current_tab], buffer);
+    FileView *view = editor->tabs[editor->current_tab];
+    int ret = file_view_load_file(view, buffer);
+    if (ret == E_IN_PROGRESS)
+    {
+        ret = text_editor_wait_load(editor, view);
+    }
+
+    if (ret == LOAD_CANCELED)
+    {
+        return text_editor_close_tab(editor);
+    }
+
     if (ret < 0)
     {
         int load_errno = errno;
@@ -431,6 +454,44 @@ int text_editor_save_file(TextEditor *editor, int save_as)
     return E_SUCCESS;
 }
 
+int text_editor_wait_load(TextEditor *editor, FileView *view)
+{
+    text_editor_render(editor);
+    top_panel(view->panel);
+    timeout(LOAD_POLL_INTERVAL);
+
+    int ret;
+    while ((ret = file_view_load_poll(view)) == E_IN_PROGRESS)
+    {
+        file_view_render(view);
+        update_panels();
+        doupdate();
+
+        int input = getch();
+        if (input == KEY_ESC)
+        {
+            file_view_cancel_load(view);
+            ret = LOAD_CANCELED;
+            break;
+        }
+        else if (input == KEY_RESIZE)
+        {
+            text_editor_handle_resize(editor);
+        }
+        else if (input != ERR)
+        {
+            file_view_handle_input(view, input);
+        }
+    }
+
+    // Keep the load error for the caller
+    int load_errno = errno;
+    timeout(-1);
+    errno = load_errno;
+
+    return ret;
+}
+
 void text_editor_set_current_tab(TextEditor *editor, int index)
 {
     if (editor->n_tabs == 0)
@@ -790,12 +851,9 @@ int text_editor_paste_selection(TextEditor *editor)
         return E_SUCCESS;
     }
 
-    for (int i = 0; i < editor->clipboard_length; i++)
+    if (file_view_insert_buffer(current_view, editor->clipboard, editor->clipboard_length) < 0)
     {
-        if (file_view_handle_input(current_view, editor->clipboard[i]) < 0)
-        {
-            return E_INTERNAL_ERROR;
-        }
+        return E_INTERNAL_ERROR;
     }
 
     file_view_render(current_view);
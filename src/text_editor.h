@@ -40,7 +40,7 @@ struct TextEditor
     PANEL *about_panel;
 
     char *clipboard;
-    int clipboard_length;
+    int64_t clipboard_length;
 };
 
 typedef struct TextEditor TextEditor;
@@ -0,0 +1,132 @@
+/*
+ * Program to measure the load throughput of file data.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include "../src/file_data.h"
+
+#define BENCHMARK_FILE_SIZE ((int64_t) 128 * 1024 * 1024)
+#define BENCHMARK_RUNS 5
+
+int generate_file(const char *file_path);
+int64_t byte_scan(const char *file_path);
+double get_time();
+
+int main(int argc, char **argv)
+{
+    const char *file_path = argc > 1 ? argv[1] : "load_benchmark.txt";
+    int runs = argc > 2 ? atoi(argv[2]) : BENCHMARK_RUNS;
+    FileData file;
+
+    if (argc < 2 && generate_file(file_path) < 0)
+    {
+        fprintf(stderr, "Failed to generate %s\n", file_path);
+        return 1;
+    }
+
+    if (create_file_data(80, &file) < 0)
+    {
+        return 1;
+    }
+
+    double best_load = 0, best_scan = 0;
+    int64_t size = 0, lines = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        // Byte by byte reference: read and count lines
+        double start = get_time();
+        size = byte_scan(file_path);
+        double scan_time = get_time() - start;
+
+        start = get_time();
+        if (size < 0 || load_file_data(&file, file_path) < 0)
+        {
+            fprintf(stderr, "Failed to load %s\n", file_path);
+            free_file_data(&file);
+            return 1;
+        }
+        double load_time = get_time() - start;
+        lines = file.lines;
+
+        if (i == 0 || load_time < best_load)
+        {
+            best_load = load_time;
+        }
+        if (i == 0 || scan_time < best_scan)
+        {
+            best_scan = scan_time;
+        }
+    }
+
+    double mb = size / (1024.0 * 1024.0);
+    printf("File:            %s (%" PRId64 " bytes, %" PRId64 " lines)\n", file_path, size, lines);
+    printf("load_file_data:  %.3f s, %.1f MB/s\n", best_load, mb / best_load);
+    printf("Byte scan:       %.3f s, %.1f MB/s\n", best_scan, mb / best_scan);
+
+    free_file_data(&file);
+    if (argc < 2)
+    {
+        remove(file_path);
+    }
+    return 0;
+}
+
+int generate_file(const char *file_path)
+{
+    FILE *fout = fopen(file_path, "w");
+    if (fout == NULL)
+    {
+        return -1;
+    }
+
+    // Lines of varying length, like source code
+    unsigned int seed = 1;
+    int64_t size = 0;
+    while (size < BENCHMARK_FILE_SIZE)
+    {
+        seed = seed * 1103515245 + 12345;
+        int len = (seed >> 16) % 120;
+        for (int i = 0; i < len; i++)
+        {
+            fputc(i < 4 ? ' ' : 'a' + (i + len) % 26, fout);
+        }
+        fputc('\n', fout);
+        size += len + 1;
+    }
+
+    return fclose(fout) == 0 ? 0 : -1;
+}
+
+int64_t byte_scan(const char *file_path)
+{
+    FILE *fin = fopen(file_path, "r");
+    if (fin == NULL)
+    {
+        return -1;
+    }
+
+    int64_t size = 0, lines = 0;
+    int c;
+    while ((c = fgetc(fin)) != EOF)
+    {
+        size++;
+        if (c == '\n')
+        {
+            lines++;
+        }
+    }
+
+    fclose(fin);
+    return lines >= 0 ? size : -1;
+}
+
+double get_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,41 @@
+/*
+ * Program to report the memory usage of file data for a file.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "../src/file_data.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <file> [display columns]\n", argv[0]);
+        return 1;
+    }
+
+    int cols = argc > 2 ? atoi(argv[2]) : 80;
+    FileData file;
+
+    if (create_file_data(cols, &file) < 0 || load_file_data(&file, argv[1]) < 0)
+    {
+        fprintf(stderr, "Failed to load %s\n", argv[1]);
+        return 1;
+    }
+
+    FileDataMemoryStats stats;
+    file_data_get_memory_stats(&file, &stats);
+
+    printf("Lines:           %" PRId64 "\n", stats.lines);
+    printf("Text bytes:      %" PRId64 "\n", stats.text_bytes);
+    printf("Original buffer: %" PRId64 "\n", stats.original_bytes);
+    printf("Mapped file:     %" PRId64 "\n", stats.mapped_bytes);
+    printf("Append buffer:   %" PRId64 " (%" PRId64 " in line slots)\n", stats.append_bytes, stats.slot_bytes);
+    printf("Node pool:       %" PRId64 "\n", stats.node_bytes);
+    printf("Caches:          %" PRId64 "\n", stats.cache_bytes);
+    printf("Total bytes:     %" PRId64 "\n", stats.total_bytes);
+    printf("Overhead / line: %.2f bytes\n", stats.overhead_per_line);
+
+    free_file_data(&file);
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Program to test file data operations on a file larger than 4 GB.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include "../src/file_data.h"
+
+#define STRESS_FILE_SIZE ((int64_t) 4 * 1024 * 1024 * 1024 + 4096)
+#define STRESS_LINE_SIZE 65535
+
+int64_t generate_file(const char *file_path);
+int64_t get_file_size(const char *file_path);
+
+int main(int argc, char **argv)
+{
+    const char *file_path = argc > 1 ? argv[1] : "stress_testing.txt";
+    const char *output_path = argc > 2 ? argv[2] : "stress_testing.out.txt";
+    FileData file;
+
+    int64_t lines = generate_file(file_path);
+    assert(lines > 0);
+    printf("Generated %" PRId64 " bytes, %" PRId64 " lines\n", STRESS_FILE_SIZE, lines);
+
+    // One display column per character, so display line indexes don't fit in 32 bits
+    assert(create_file_data(1, &file) >= 0);
+    assert(load_file_data(&file, file_path) >= 0);
+    assert(file.original_mapped);
+
+    // Large files are indexed on request
+    assert(file_data_index_all(&file) >= 0);
+    assert(file.lines == lines);
+    assert(file.size > INT32_MAX);
+    file_data_check_integrity(&file);
+
+    // Edit the last source line, past 2 G display lines
+    int64_t display_line, display_col;
+    assert(file_data_get_display_coords(&file, lines - 1, 0, &display_line, &display_col) >= 0);
+    assert(display_line > INT32_MAX);
+    display_line += 10;
+
+    assert(file_data_insert_char(&file, display_line, 0, 'x') >= 0);
+    assert(file_data_insert_char(&file, display_line, 0, '\n') >= 0);
+    assert(file.lines == lines + 1);
+
+    const FileLine *line = get_file_data_line(&file, display_line);
+    assert(line != NULL && line->line == lines && line->col_start == 0 && line->content[0] == 'x');
+
+    int64_t source_line, source_col;
+    assert(file_data_get_source_coords(&file, display_line, 0, &source_line, &source_col) >= 0);
+    assert(source_line == lines && source_col == 0);
+
+    assert(file_data_delete_char(&file, display_line, -1) >= 0);
+    assert(file_data_delete_char(&file, display_line, 0) >= 0);
+    assert(file.lines == lines);
+    file_data_check_integrity(&file);
+
+    // Resize back to a usual number of columns
+    assert(resize_file_data_col(&file, 80) >= 0);
+    file_data_check_integrity(&file);
+
+    assert(save_file_data(&file, output_path) >= 0);
+    assert(get_file_size(output_path) == STRESS_FILE_SIZE);
+
+    free_file_data(&file);
+    file_data_remove_line_index(file_path);
+    remove(file_path);
+    remove(output_path);
+    return 0;
+}
+
+int64_t generate_file(const char *file_path)
+{
+    FILE *fout = fopen(file_path, "w");
+    if (fout == NULL)
+    {
+        return -1;
+    }
+
+    char buffer[STRESS_LINE_SIZE + 1];
+    for (int i = 0; i < STRESS_LINE_SIZE; i++)
+    {
+        buffer[i] = 'a' + i % 26;
+    }
+    buffer[STRESS_LINE_SIZE] = '\n';
+
+    int64_t size = 0;
+    int64_t lines = 0;
+    while (size < STRESS_FILE_SIZE)
+    {
+        int64_t len = STRESS_FILE_SIZE - size < STRESS_LINE_SIZE + 1 ? STRESS_FILE_SIZE - size : STRESS_LINE_SIZE + 1;
+        buffer[len - 1] = '\n';
+
+        if (fwrite(buffer, sizeof(char), len, fout) != (size_t) len)
+        {
+            fclose(fout);
+            return -1;
+        }
+
+        size += len;
+        lines++;
+    }
+
+    if (fclose(fout) != 0)
+    {
+        return -1;
+    }
+
+    return lines;
+}
+
+int64_t get_file_size(const char *file_path)
+{
+    struct stat st;
+    if (stat(file_path, &st) != 0)
+    {
+        return -1;
+    }
+
+    return st.st_size;
+}
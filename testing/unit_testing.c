@@ -1,10 +1,13 @@
 /*
- * Program to test file data operations.
+ * Program to test file data and file view operations.
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
-#include "../src/file_data.h"
+#include <inttypes.h>
+#include <zlib.h>
+#include "../src/file_view.h"
 
 void print_file_data(FileData *file_data);
 
@@ -81,16 +84,155 @@ int main()
     assert(file_data_delete_char(&file, 0, 1) >= 0);
     file_data_check_integrity(&file);
 
+    assert(file_data_insert_buffer(&file, 0, 0, "xyz", 3) >= 0);
+    file_data_check_integrity(&file);
+
+    assert(file_data_insert_buffer(&file, 0, 1, "ab\ncd\n\nef", 9) >= 0);
+    file_data_check_integrity(&file);
+
+    assert(file_data_insert_buffer(&file, 0, 0, "\x01\r", 2) >= 0);
+    assert(memcmp(get_file_data_line(&file, 0)->content, "\x01\r", 2) == 0);
+    assert(file_data_delete_range(&file, 0, 0, 0, 2) >= 0);
+    file_data_check_integrity(&file);
+
+    assert(file_data_delete_range(&file, 0, 1, 0, 3) >= 0);
+    file_data_check_integrity(&file);
+
+    assert(file_data_delete_range(&file, 0, 1, 2, 1) >= 0);
+    file_data_check_integrity(&file);
+
+    assert(file_data_begin_transaction(&file) >= 0);
+    assert(file_data_insert_buffer(&file, 0, 0, "ab\ncd\nef\n", 9) >= 0);
+    assert(file_data_insert_char(&file, 0, 1, 'x') >= 0);
+    assert(file_data_insert_char(&file, 2, 1, 'y') >= 0);
+    assert(file_data_delete_char(&file, 1, 0) >= 0);
+    file_data_check_integrity(&file);
+
+    assert(file_data_commit_transaction(&file) >= 0);
+    file_data_check_integrity(&file);
+
+    FileDataSaveStats save_stats;
+    assert(save_file_data(&file, "data/file_save.txt") >= 0);
+    assert(file_data_get_save_stats(&file, &save_stats) >= 0 && save_stats.bytes_written > 0);
+
+    assert(file_data_insert_char(&file, file.size - 1, 2, 'z') >= 0);
+    assert(save_file_data(&file, "data/file_save.txt") >= 0);
+    assert(file_data_get_save_stats(&file, &save_stats) >= 0 && save_stats.in_place);
+    assert(remove("data/file_save.txt") == 0);
+
     free_file_data(&file);
+
+    // Bytes are stored verbatim, the file is saved unchanged
+    const char binary[] = "a\r\nb\0\x1b[0m\n\xc3\xa9\xff";
+    char saved[sizeof(binary)];
+    FILE *f = fopen("data/file_binary.txt", "wb");
+    assert(f != NULL && fwrite(binary, 1, sizeof(binary) - 1, f) == sizeof(binary) - 1 && fclose(f) == 0);
+
+    assert(create_file_data(3, &file) >= 0);
+    assert(load_file_data(&file, "data/file_binary.txt") >= 0 && file.lines == 3);
+    file_data_check_integrity(&file);
+    assert(save_file_data(&file, "data/file_save.txt") >= 0);
+
+    f = fopen("data/file_save.txt", "rb");
+    assert(f != NULL && fread(saved, 1, sizeof(saved), f) == sizeof(binary) - 1 && fclose(f) == 0);
+    assert(memcmp(saved, binary, sizeof(binary) - 1) == 0);
+    assert(remove("data/file_save.txt") == 0 && remove("data/file_binary.txt") == 0);
+
+    // Lines with multibyte characters are flagged, columns are aligned to character boundaries
+    int64_t row, col;
+    assert(get_file_data_line(&file, 0)->encoding == FILE_LINE_ASCII);
+    assert(file_data_get_display_coords(&file, 2, 0, &row, &col) >= 0 && get_file_data_line(&file, row)->encoding == FILE_LINE_BINARY);
+    assert(file_data_delete_char(&file, row, 2) >= 0 && get_file_data_line(&file, row)->encoding == FILE_LINE_UTF8);
+    assert(file_data_align_char(&file, 2, 1, 0, &col) >= 0 && col == 0);
+    assert(file_data_align_char(&file, 2, 1, 1, &col) >= 0 && col == 2);
+    file_data_check_integrity(&file);
+    free_file_data(&file);
+
+    // Tabs extend to the next tab stop, lines with tabs are wrapped by visual width
+    int64_t visual;
+    assert(create_file_data(6, &file) >= 0);
+    assert(file_data_insert_buffer(&file, 0, 0, "a\tbc\td", 6) >= 0 && file.size == 2);
+    assert(get_file_data_line(&file, 1)->col_start == 4 && get_file_data_line(&file, 1)->visual_start == 6);
+    assert(file_data_get_visual_col(&file, 0, -1, &visual) >= 0 && visual == 9);
+    assert(file_data_get_visual_source_col(&file, 0, 2, &col) >= 0 && col == 1);
+    assert(file_data_delete_char(&file, 0, 1) >= 0 && file.size == 1);
+    file_data_check_integrity(&file);
+    free_file_data(&file);
+
+    // Gzip files are decompressed when loaded and compressed again when saved
+    const char text[] = "ab\ncd\n";
+    char decompressed[sizeof(text)];
+    gzFile gz = gzopen("data/file.txt.gz", "wb");
+    assert(gz != NULL && gzwrite(gz, text, sizeof(text) - 1) == sizeof(text) - 1 && gzclose(gz) == Z_OK);
+
+    assert(create_file_data(3, &file) >= 0);
+    assert(load_file_data(&file, "data/file.txt.gz") >= 0 && file.lines == 2 && file.compression == FILE_DATA_COMPRESSION_GZIP);
+    assert(memcmp(get_file_data_line(&file, 1)->content, "cd", 2) == 0);
+    assert(file_data_insert_char(&file, 0, 0, 'x') >= 0);
+    assert(save_file_data(&file, "data/file_save.txt.gz") >= 0);
+
+    gz = gzopen("data/file_save.txt.gz", "rb");
+    assert(gz != NULL && gzread(gz, decompressed, sizeof(decompressed)) == sizeof(text) && gzclose(gz) == Z_OK);
+    assert(memcmp(decompressed, "xab\ncd\n", sizeof(text)) == 0);
+
+    assert(file_data_load_start(&file, "data/file_save.txt.gz") >= 0);
+    while (file_data_load_poll(&file, NULL) == E_IN_PROGRESS);
+    assert(file.lines == 2 && file.original_size == sizeof(text));
+    file_data_check_integrity(&file);
+    assert(remove("data/file_save.txt.gz") == 0 && remove("data/file.txt.gz") == 0);
+    free_file_data(&file);
+
+    assert(create_file_data(3, &file) >= 0);
+    assert(file_data_load_start(&file, "data/file.txt") >= 0);
+
+    int ret;
+    FileDataLoadProgress progress;
+    while ((ret = file_data_load_poll(&file, &progress)) == E_IN_PROGRESS);
+    assert(ret >= 0 && progress.bytes_read == progress.total_bytes);
+    file_data_check_integrity(&file);
+
+    assert(file_data_load_start(&file, "data/file.txt") >= 0);
+    file_data_load_cancel(&file);
+    assert(file_data_load_start(&file, "data/missing.txt") == E_IO_ERROR);
+
+    free_file_data(&file);
+
+    // Copied selections spanning wrapped lines hold the whole selected range
+    FILE *null_out = fopen("/dev/null", "w");
+    FILE *null_in = fopen("/dev/null", "r");
+    assert(null_out != NULL && null_in != NULL && newterm("xterm", null_out, null_in) != NULL);
+
+    char long_line[101];
+    memset(long_line, 'a', 100);
+    long_line[100] = '\n';
+    FileView *view = create_file_view(10, 11, 0, 0);
+    assert(view != NULL && file_view_insert_buffer(view, long_line, sizeof(long_line)) >= 0);
+    assert(file_view_insert_buffer(view, "bc", 2) >= 0);
+
+    char *copied;
+    int64_t copied_len;
+    view->sel_active = 1;
+    view->sel_start_line = 0;
+    view->sel_start_col = 2;
+    view->sel_stop_line = 1;
+    view->sel_stop_col = 1;
+    assert(file_view_copy_selection(view, &copied, &copied_len) >= 0 && copied_len == 100);
+    assert(memcmp(copied, long_line + 2, 99) == 0 && copied[99] == 'b');
+    free(copied);
+
+    free_file_view(view);
+    endwin();
+    fclose(null_out);
+    fclose(null_in);
     return 0;
 }
 
 void print_file_data(FileData *file_data)
 {
-    for(int i = 0; i < file_data->size; i++)
+    for(int64_t i = 0; i < file_data->size; i++)
     {
         const FileLine *data = get_file_data_line(file_data, i);
-        printf("(%d:%d - %d) %s %c\n", data->line, data->col_start, data->size, data->content, data->endl ? '$' : '>');
+        printf("(%" PRId64 ":%" PRId64 " - %" PRId64 ") %.*s %c\n", data->line, data->col_start, data->size, (int) data->size, data->content, data->endl ? '$' : '>');
     }
-    printf("File lines: %d, display lines: %d\n", file_data->end != NULL ? file_data->end->data.line + 1 : 0, file_data->size);
+    printf("File lines: %" PRId64 ", display lines: %" PRId64 "\n", file_data->lines, file_data->size);
 }
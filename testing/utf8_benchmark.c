@@ -0,0 +1,155 @@
+/*
+ * Program to measure the load and render throughput of ASCII and mixed-script UTF-8 files.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <locale.h>
+#include <langinfo.h>
+#include <time.h>
+#include "../src/file_view.h"
+
+#define BENCHMARK_FILE_SIZE ((int64_t) 64 * 1024 * 1024)
+#define BENCHMARK_RUNS 3
+#define BENCHMARK_SCREENS 5000
+#define SCREEN_HEIGHT 50
+#define SCREEN_WIDTH 120
+
+int generate_file(const char *file_path, int mixed);
+int benchmark_file(const char *file_path, const char *name);
+double get_time();
+
+int main()
+{
+    // Wide characters are only rendered in a UTF-8 locale
+    if (setlocale(LC_ALL, "C.UTF-8") == NULL)
+    {
+        setlocale(LC_ALL, "");
+    }
+
+    FILE *null_out = fopen("/dev/null", "w");
+    FILE *null_in = fopen("/dev/null", "r");
+    if (null_out == NULL || null_in == NULL || newterm("xterm", null_out, null_in) == NULL)
+    {
+        fprintf(stderr, "Failed to initialize terminal\n");
+        return 1;
+    }
+
+    const char *ascii_path = "utf8_benchmark_ascii.txt";
+    const char *mixed_path = "utf8_benchmark_mixed.txt";
+    int ret = 0;
+
+    if (generate_file(ascii_path, 0) < 0 || generate_file(mixed_path, 1) < 0)
+    {
+        endwin();
+        fprintf(stderr, "Failed to generate benchmark files\n");
+        ret = 1;
+    }
+    else
+    {
+        printf("Locale encoding: %s\n", nl_langinfo(CODESET));
+        ret = benchmark_file(ascii_path, "ASCII") < 0 || benchmark_file(mixed_path, "Mixed-script") < 0;
+    }
+
+    remove(ascii_path);
+    remove(mixed_path);
+    return ret;
+}
+
+int generate_file(const char *file_path, int mixed)
+{
+    // Latin, accented Latin, Cyrillic, Greek, CJK and emoji words
+    static const char *words[] = {
+        "text", "editor", "buffer", "line", "caf\xc3\xa9", "na\xc3\xafve", "\xc3\xbc" "ber",
+        "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "\xd0\xbc\xd0\xb8\xd1\x80",
+        "\xce\xb1\xce\xb2\xce\xb3", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", "\xe4\xb8\xad\xe6\x96\x87",
+        "\xf0\x9f\x98\x80", "\xf0\x9f\x9a\x80"
+    };
+    const int ascii_words = 4, all_words = sizeof(words) / sizeof(words[0]);
+
+    FILE *fout = fopen(file_path, "w");
+    if (fout == NULL)
+    {
+        return -1;
+    }
+
+    // Lines of varying length, each word picked from the script set of the file
+    unsigned int seed = 1;
+    int64_t size = 0;
+    while (size < BENCHMARK_FILE_SIZE)
+    {
+        seed = seed * 1103515245 + 12345;
+        int count = (seed >> 16) % 20;
+        for (int i = 0; i < count; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            const char *word = words[(seed >> 16) % (mixed ? all_words : ascii_words)];
+            size += fprintf(fout, "%s ", word);
+        }
+        fputc('\n', fout);
+        size++;
+    }
+
+    return fclose(fout) == 0 ? 0 : -1;
+}
+
+int benchmark_file(const char *file_path, const char *name)
+{
+    FileView *view = create_file_view(SCREEN_HEIGHT, SCREEN_WIDTH, 0, 0);
+    if (view == NULL)
+    {
+        return -1;
+    }
+
+    // Load throughput, best of several runs
+    double best_load = 0;
+    for (int i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        double start = get_time();
+        if (load_file_data(view->data, file_path) < 0)
+        {
+            free_file_view(view);
+            return -1;
+        }
+        double load_time = get_time() - start;
+
+        if (i == 0 || load_time < best_load)
+        {
+            best_load = load_time;
+        }
+    }
+
+    view->status = FILE_VIEW_STATUS_SAVED;
+    int64_t size = view->data->original_size;
+
+    // Render throughput, screens scrolled through the start of the file
+    int64_t rows = 0, screens = 0;
+    double start = get_time();
+    for (int64_t offset = 0; screens < BENCHMARK_SCREENS && offset < view->data->size; offset += SCREEN_HEIGHT)
+    {
+        view->scroll_offset = offset;
+        file_view_render(view);
+        rows += SCREEN_HEIGHT;
+        screens++;
+    }
+    double render_time = get_time() - start;
+
+    double mb = size / (1024.0 * 1024.0);
+    endwin();
+    printf("%s file: %" PRId64 " bytes, %" PRId64 " lines\n", name, size, view->data->lines);
+    printf("  load_file_data:   %.3f s, %.1f MB/s\n", best_load, mb / best_load);
+    printf("  file_view_render: %.3f s, %" PRId64 " screens, %.0f rows/s\n", render_time, screens, rows / render_time);
+
+    free_file_view(view);
+    return 0;
+}
+
+double get_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}